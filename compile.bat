@@ -33,6 +33,14 @@ if "%dbg%"=="1" (
 	set ldflags=-O2
 )
 
+:: per-handler event timing, see src/evprof.h
+set evprof=0
+if "%evprof%"=="1" set cflags=%cflags% -DSST_EVPROF
+
+:: plugin load timeline, see src/loadprof.h
+set loadprof=0
+if "%loadprof%"=="1" set cflags=%cflags% -DSST_LOADPROF
+
 set objs=
 goto :main
 
@@ -84,6 +92,7 @@ setlocal DisableDelayedExpansion
 :+ hexcolour.c
 :+ hook.c
 :+ hud.c
+:+ initsched.c
 :+ inputhud.c
 :+ kvsys.c
 :+ l4d1democompat.c
@@ -96,7 +105,9 @@ setlocal DisableDelayedExpansion
 :+ os.c
 :+ portalcolours.c
 :+ portalisg.c
+:+ propdump.c
 :+ rinput.c
+:+ speedometer.c
 :+ sst.c
 :+ trace.c
 :+ xhair.c
@@ -104,6 +115,8 @@ setlocal DisableDelayedExpansion
 if "%dbg%"=="1" set src=%src% src/dbg.c
 if "%dbg%"=="1" set src=%src% src/udis86.c
 if "%dbg%"=="0" set src=%src% src/wincrt.c
+if "%evprof%"=="1" set src=%src% src/evprof.c
+if "%loadprof%"=="1" set src=%src% src/loadprof.c
 
 %CC% -fuse-ld=lld -shared -O0 -w -o .build/bcryptprimitives.dll -Wl,-def:src/stubs/bcryptprimitives.def src/stubs/bcryptprimitives.c
 set lbcryptprimitives_host=-lbcryptprimitives
@@ -121,10 +134,13 @@ if %host64%==1 (
 -L.build %lbcryptprimitives_host% -o .build/mkgamedata.exe src/build/mkgamedata.c src/os.c || goto :end
 %HOSTCC% -fuse-ld=lld -O2 %warnings% %stdflags% -include stdbool.h ^
 -L.build %lbcryptprimitives_host% -o .build/mkentprops.exe src/build/mkentprops.c src/os.c || goto :end
+%HOSTCC% -fuse-ld=lld -O2 %warnings% %stdflags% -include stdbool.h ^
+-L.build %lbcryptprimitives_host% -o .build/mkcutscenes.exe src/build/mkcutscenes.c src/os.c || goto :end
 .build\gluegen.exe%src% || goto :end
 .build\mkgamedata.exe gamedata/engine.txt gamedata/gamelib.txt gamedata/inputsystem.txt ^
 gamedata/matchmaking.txt gamedata/vgui2.txt gamedata/vguimatsurface.txt gamedata/vphysics.txt || goto :end
 .build\mkentprops.exe gamedata/entprops.txt || goto :end
+.build\mkcutscenes.exe gamedata/l4dcutscenes.txt || goto :end
 llvm-rc /FO .build\dll.res src\dll.rc || goto :end
 for %%b in (%src%) do ( call :cc %%b || goto :end )
 :: we need different library names for debugging because Microsoft...
@@ -160,9 +176,15 @@ if exist .build\sst.old.dll del .build\sst.old.dll >nul 2>nul
 
 %HOSTCC% -fuse-ld=lld -O2 -g %warnings% %stdflags% -include test/test.h -o .build/bitbuf.test.exe test/bitbuf.test.c || goto :end
 .build\bitbuf.test.exe || goto :end
+%HOSTCC% -fuse-ld=lld -O2 -g %warnings% %stdflags% -L.build %lbcryptprimitives_host% -include test/test.h -o .build/gluegen.test.exe test/gluegen.test.c || goto :end
+.build\gluegen.test.exe || goto :end
+%HOSTCC% -fuse-ld=lld -O2 -g %warnings% %stdflags% -lntdll -include test/test.h -o .build/initsched.test.exe test/initsched.test.c || goto :end
+.build\initsched.test.exe || goto :end
 :: special case: test must be 32-bit
 %HOSTCC% -fuse-ld=lld -m32 -O2 -g %warnings% %stdflags% -L.build -lbcryptprimitives -include test/test.h -o .build/hook.test.exe test/hook.test.c || goto :end
 .build\hook.test.exe || goto :end
+%HOSTCC% -fuse-ld=lld -O2 -g %warnings% %stdflags% -include test/test.h -o .build/spscring.test.exe test/spscring.test.c || goto :end
+.build\spscring.test.exe || goto :end
 %HOSTCC% -fuse-ld=lld -O2 -g %warnings% %stdflags% -include test/test.h -o .build/x86.test.exe test/x86.test.c || goto :end
 .build\x86.test.exe || goto :end
 
@@ -4,17 +4,20 @@
 #define strncasecmp _strnicmp
 #endif
 
+// NOTE: tokenizer state made thread-local so that gluegen can scan multiple
+// files in parallel
+
 // Input file
-static File *current_file;
+static _Thread_local File *current_file;
 
 // A list of all input files.
-static File **input_files;
+static _Thread_local File **input_files;
 
 // True if the current position is at the beginning of a line
-static bool at_bol;
+static _Thread_local bool at_bol;
 
 // True if the current position follows a space character
-static bool has_space;
+static _Thread_local bool has_space;
 
 // Reports an error and exit.
 void error(char *fmt, ...) {
@@ -161,7 +164,7 @@ static int read_punct(char *p) {
 }
 
 static bool is_keyword(Token *tok) {
-  static HashMap map;
+  static _Thread_local HashMap map;
 
   if (map.capacity == 0) {
     static char *kw[] = {
@@ -772,7 +775,7 @@ Token *tokenize_buf(const char *name, char *p) {
   convert_universal_chars(p);
 
   // Save the filename for assembler .file directive.
-  static int file_no;
+  static _Thread_local int file_no;
   File *file = new_file((char *)name, file_no + 1, p);
 
   // Save the filename for assembler .file directive.
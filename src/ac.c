@@ -44,6 +44,7 @@
 #include "mem.h"
 #include "os.h"
 #include "ppmagic.h"
+#include "spscring.h"
 #include "sst.h"
 #include "vcall.h"
 #include "x86util.h"
@@ -66,6 +67,10 @@ static struct keybox {
 	crypto_rng_ctx rng; // NOTE: keep this at the end, for wipesessionkeys()
 } *keybox;
 
+// set on DemoRecordStarting (if enabled) and cleared on DemoRecordStopped, so
+// that whatever happens to be in keybox otherwise never gets used to encrypt
+static bool havesessionkeys = false;
+
 enum {
 	LBPK_L4D
 };
@@ -87,14 +92,63 @@ static void newsessionkeys() {
 	crypto_blake2b(keybox->shr, sizeof(keybox->tmp), keybox->tmp, 96);
 	crypto_wipe(keybox->tmp, sizeof(keybox->tmp));
 	keybox->nonce = 0;
+	havesessionkeys = true;
 }
 
 static void wipesessionkeys() {
 	crypto_wipe(keybox->prv, offsetof(struct keybox, rng));
+	havesessionkeys = false;
 }
 
 HANDLE_EVENT(DemoRecordStarting) { if (enabled) newsessionkeys(); }
-HANDLE_EVENT(DemoRecordStopped, int ndemos) { if (enabled) wipesessionkeys(); }
+HANDLE_EVENT(DemoRecordStopped, int ndemos) {
+	// n.b. not checking enabled, in case ac_disable() was called mid-demo
+	if (havesessionkeys) wipesessionkeys();
+}
+
+// suspicious inputs seen by the hook thread. the hook has a strict deadline, so
+// it just pushes raw events here and the main thread does the expensive part
+// (encoding, encryption, demo writing) in batches at Tick.
+struct rawkey { u32 vk, scan; };
+DEF_SPSCRING(keyring, struct rawkey, 256)
+static struct keyring fakekeys;
+static _Atomic uint fakekeysdropped = 0; // only if the main thread falls behind
+
+#define KEYBATCH 32 // biggest batch we'll encode as one message
+
+static void logfakekeys() {
+	// 19 = max size of one key, 16 = mac
+	static uchar buf[1 + 9 + 3 + KEYBATCH * 19 + 5 + 16];
+	struct rawkey keys[KEYBATCH];
+	int n;
+	while ((n = keyring_pop(&fakekeys, keys, KEYBATCH))) {
+		// no keys to encrypt with if there's no demo, so just discard events,
+		// along with the drop count, which would only apply to those anyway
+		if (!enabled || !havesessionkeys) {
+			atomic_store_explicit(&fakekeysdropped, 0, memory_order_relaxed);
+			continue;
+		}
+		uint dropped = atomic_exchange_explicit(&fakekeysdropped, 0,
+				memory_order_relaxed);
+		uchar *p = buf;
+		msg_putasz4(p, 3); p += 1;
+			msg_putssz5(p, 8); memcpy(p + 1, "FakeKeys", 8); p += 9;
+			p += msg_putasz16(p, n);
+			for (int i = 0; i < n; ++i) {
+				msg_putmsz4(p, 2); p += 1;
+					msg_putssz5(p, 2); memcpy(p + 1, "vk", 2); p += 3;
+						p += msg_putu32(p, keys[i].vk);
+					msg_putssz5(p, 4); memcpy(p + 1, "scan", 4); p += 5;
+						p += msg_putu32(p, keys[i].scan);
+			}
+			p += msg_putu32(p, dropped);
+		++keybox->nonce;
+		// append mac at end of message
+		crypto_aead_lock_djb(buf, p, keybox->shr, keybox->nonce_bytes, 0, 0,
+				buf, p - buf);
+		democustom_write(buf, p - buf + 16);
+	}
+}
 
 #ifdef _WIN32
 
@@ -107,21 +161,11 @@ static ssize __stdcall kproc(int code, usize wp, ssize lp) {
 		// fast-path the next branch because alt-tabbed speed is irrelevant
 		if_hot (GetForegroundWindow() == gamewin) {
 			// maybe this input is reasonable, but log it for closer inspection
-			// TODO(rta): figure out what to do with this stuff
-			// something like the following, but with a proper abstraction...
-			//uchar buf[28 + 16], *p = buf;
-			//msg_putasz4(p, 2); p += 1;
-			//	msg_putssz5(p, 8); memcpy(p + 1, "FakeKey", 7); p += 8;
-			//	msg_putmsz4(p, 2); p += 1;
-			//		msg_putssz5(p, 3); memcpy(p + 1, "vk", 2); p += 3;
-			//			p += msg_putu32(p, data->vkCode);
-			//		msg_putssz5(p, 3); memcpy(p + 1, "scan", 4); p += 5;
-			//			p += msg_putu32(p, data->scanCode);
-			//++keybox->nonce;
-			//// append mac at end of message
-			//crypto_aead_lock_djb(buf, p, keybox->shr, keybox->nonce_bytes, 0,
-			//		0, buf, p - buf);
-			//democustom_write(buf, p - buf + 16);
+			struct rawkey k = {data->vkCode, data->scanCode};
+			if_cold (!keyring_push(&fakekeys, k)) {
+				atomic_fetch_add_explicit(&fakekeysdropped, 1,
+						memory_order_relaxed);
+			}
 		}
 	}
 	return CallNextHookEx(0, code, wp, lp);
@@ -253,6 +297,7 @@ HANDLE_EVENT(Tick, bool simulating) {
 	// just check this every so often (roughly 0.1-0.3s depending on game)
 	if (enabled && !(++fewticks & 7)) inhook_check();
 #endif
+	logfakekeys();
 }
 
 void ac_disable() {
@@ -103,7 +103,7 @@ struct cmeta cmeta_loadfile(const os_char *path) {
 	*realname = *path;
 	for (const ushort *p = path + 1; p[-1]; ++p) realname[p - path] = *p;
 #else
-	const char *realname = f;
+	const char *realname = path;
 #endif
 	struct Token *t = tokenize_buf(realname, ret.sbase);
 	// everything is THING() or THING {} so we need at least 3 tokens ahead - if
@@ -159,6 +159,12 @@ struct cmeta cmeta_loadfile(const os_char *path) {
 		else if (equal(t, "END") && equal(t->next, "{")) {
 			type = CMETA_ITEM_END;
 		}
+		else if (equal(t, "SCAN") && equal(t->next, "{")) {
+			type = CMETA_ITEM_SCAN;
+		}
+		else if (equal(t, "PRESCAN") && equal(t->next, "{")) {
+			type = CMETA_ITEM_PRESCAN;
+		}
 		else {
 			t = t->next;
 			continue;
@@ -33,7 +33,9 @@ enum cmeta_item {
 	CMETA_ITEM_GAMESPECIFIC,
 	CMETA_ITEM_PREINIT,
 	CMETA_ITEM_INIT,
-	CMETA_ITEM_END
+	CMETA_ITEM_END,
+	CMETA_ITEM_SCAN,
+	CMETA_ITEM_PRESCAN
 };
 
 struct cmeta {
@@ -14,9 +14,17 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../intdefs.h"
 #include "../langext.h"
@@ -41,10 +49,44 @@ static cold noreturn diefile(int status, const os_char *f, int line,
 	exit(status);
 }
 
-#define ARENASZ (1024 * 1024)
-static _Alignas(64) char _arena[ARENASZ] = {0}, *const arena = _arena - 64;
+// the arena reserves a big range of address space up front and commits memory
+// as needed. this lets it grow without moving, since list tails and some
+// strings hold raw pointers into it which realloc() would invalidate.
+#define ARENA_RESERVE (256 * 1024 * 1024) // N.B. offsets are ints; keep < 2G
+#define ARENA_COMMITSZ (1024 * 1024)
+static char *arena; // offset by -64 so 0 indices can be null; see arena_init()
 static int arena_last = 0;
 static int arena_used = 64; // using 0 indices as null; reserve and stay aligned
+static int arena_committed = 0; // N.B. counted from the real base, not arena
+
+static void arena_init() {
+#ifdef _WIN32
+	char *base = VirtualAlloc(0, ARENA_RESERVE, MEM_RESERVE, PAGE_NOACCESS);
+	if_cold (!base) die(100, "couldn't reserve arena memory");
+#else
+	char *base = mmap(0, ARENA_RESERVE, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if_cold (base == MAP_FAILED) die(100, "couldn't reserve arena memory");
+#endif
+	arena = base - 64;
+}
+
+static cold void arena_grow(int needed) {
+	if_cold (needed > ARENA_RESERVE) die(2, "out of arena memory");
+	int newcommit = (needed + ARENA_COMMITSZ - 1) & ~(ARENA_COMMITSZ - 1);
+	char *p = arena + 64 + arena_committed;
+	int sz = newcommit - arena_committed;
+#ifdef _WIN32
+	if_cold (!VirtualAlloc(p, sz, MEM_COMMIT, PAGE_READWRITE)) {
+		die(100, "couldn't commit arena memory");
+	}
+#else
+	if_cold (mprotect(p, sz, PROT_READ | PROT_WRITE) == -1) {
+		die(100, "couldn't commit arena memory");
+	}
+#endif
+	arena_committed = newcommit;
+}
 
 static inline void _arena_align() {
 	enum { ALIGN = ssizeof(void *) };
@@ -52,7 +94,9 @@ static inline void _arena_align() {
 }
 
 static inline int arena_bump(int amt) {
-	if_cold (arena_used + amt >= ARENASZ) die(2, "out of arena memory");
+	if_cold (arena_used + amt - 64 > arena_committed) {
+		arena_grow(arena_used + amt - 64);
+	}
 	int ret = arena_used;
 	arena_used += amt;
 	return ret;
@@ -82,7 +126,7 @@ static struct list_grow_ret {
 		int allocsz = ssizeof(struct list_chunkhdr) + amt;
 		int new = arena_new(allocsz > LIST_MINALLOC ? allocsz : LIST_MINALLOC);
 		struct list_chunkhdr *newptr = (struct list_chunkhdr *)(arena + new);
-		newptr->next = 0; newptr->sz = 0;
+		newptr->next = 0; newptr->sz = amt;
 		tail->next = new;
 		return (struct list_grow_ret){newptr, (char *)(newptr + 1)};
 	}
@@ -145,10 +189,12 @@ enum {
 	HAS_END = 4,
 	HAS_EVENTS = 8,
 	HAS_OPTDEPS = 16, // something else depends on *us* with REQUEST()
+	HAS_SCAN = 32,
 	DFS_SEEING = 64, // for REQUIRE() cycle detection
-	DFS_SEEN = 128
+	DFS_SEEN = 128,
+	HAS_PRESCAN = 256
 };
-static u8 mod_flags[MAX_MODULES] = {0};
+static u16 mod_flags[MAX_MODULES] = {0};
 static SHUNT(struct list_chunk, mod_needs)[MAX_MODULES] = {0};
 static SHUNT(struct list_chunk, mod_wants)[MAX_MODULES] = {0};
 static SHUNT(struct list_chunk, mod_gamedata)[MAX_MODULES] = {0};
@@ -530,6 +576,21 @@ static inline void handle(s16 mod, s16 mods, s16 *featdescs, s16 *events,
 				}
 				mod_flags[mod] |= HAS_END;
 				needfeat = "END block defined";
+				break;
+			case CMETA_ITEM_SCAN:
+				if_cold (mod_flags[mod] & HAS_SCAN) {
+					diefile(2, file, cmeta_line(cm, i), "multiple SCAN blocks");
+				}
+				mod_flags[mod] |= HAS_SCAN;
+				needfeat = "SCAN block defined";
+				break;
+			case CMETA_ITEM_PRESCAN:
+				if_cold (mod_flags[mod] & HAS_PRESCAN) {
+					diefile(2, file, cmeta_line(cm, i),
+							"multiple PRESCAN blocks");
+				}
+				mod_flags[mod] |= HAS_PRESCAN;
+				needfeat = "PRESCAN block defined";
 		}
 	}
 	if_cold (needfeat && !isfeat) {
@@ -543,6 +604,9 @@ static inline void handle(s16 mod, s16 mods, s16 *featdescs, s16 *events,
 	if_cold (!canpreinit && haspreinit) {
 		diefile(2, file, 0, "cannot use dependencies along with PREINIT");
 	}
+	if_cold ((mod_flags[mod] & (HAS_PRESCAN | HAS_SCAN)) == HAS_PRESCAN) {
+		diefile(2, file, 0, "PRESCAN block defined without SCAN block");
+	}
 }
 
 static int dfs(s16 mod, bool first);
@@ -686,6 +750,130 @@ static int evargs_notype(FILE *out, s16 i, const char *suffix) {
 	return j;
 }
 
+// SCAN blocks that a feature's own SCAN has to wait for: those of everything
+// it depends on, directly or through features that don't have SCAN blocks.
+// writes out the task indices if out is non-null; returns the count either way.
+static s16 scanidx[MAX_MODULES]; // 1-based, 0 = no SCAN
+static bool scanseen[MAX_MODULES];
+
+static int scandep(FILE *out, s16 dep, int n);
+static int scandeps(FILE *out, s16 mod, int n) {
+	list_foreach (s16, dep, mod_needs + mod) n = scandep(out, dep, n);
+	list_foreach (s16, dep, mod_wants + mod) n = scandep(out, dep, n);
+	return n;
+}
+
+static int scandep(FILE *out, s16 dep, int n) {
+	if (scanseen[dep]) return n;
+	scanseen[dep] = true;
+	// no need to look any further if the dependency itself has a SCAN, since
+	// that in turn will wait for anything *it* depends on
+	if (!scanidx[dep]) return scandeps(out, dep, n);
+	if (out && fprintf(out, "%s%d", n ? ", " : "", scanidx[dep] - 1) < 0) {
+		diewrite();
+	}
+	return n + 1;
+}
+
+static void scanconds(FILE *out, s16 mod) {
+	// same skip conditions as initfeatures(), minus the feature dependencies
+	// which initsched_run() deals with itself
+	const char *and = "";
+	if (mod_flags[mod] & HAS_PREINIT) {
+		if_cold (fprintf(out, "feats.preinit_%.*s == FEAT_OK",
+				mod_names[mod].len, mod_names[mod].s) < 0) {
+			diewrite();
+		}
+		and = " && ";
+	}
+	if (mod_gamespecific[mod].s) {
+		if_cold (fprintf(out, "%sGAMETYPE_MATCHES(%.*s)", and,
+				mod_gamespecific[mod].len, mod_gamespecific[mod].s) < 0) {
+			diewrite();
+		}
+		and = " && ";
+	}
+	list_foreach (struct cmeta_slice, gamedata, mod_gamedata + mod) {
+		if (mod_gamespecific[mod].s) {
+			if_cold (fprintf(out, "%s_HAS_%.*s(_gametype_tag_%.*s)", and,
+					gamedata.len, gamedata.s, mod_gamespecific[mod].len,
+					mod_gamespecific[mod].s) < 0) {
+				diewrite();
+			}
+		}
+		else if_cold (fprintf(out, "%s_HAS_%.*s(0)", and,
+				gamedata.len, gamedata.s) < 0) {
+			diewrite();
+		}
+		and = " && ";
+	}
+	list_foreach (struct cmeta_slice, global, mod_globals + mod) {
+		if_cold (fprintf(out, "%s(%.*s)", and, global.len, global.s) < 0) {
+			diewrite();
+		}
+		and = " && ";
+	}
+	if (!*and && fputs("true", out) < 0) diewrite();
+}
+
+static bool genscans(FILE *out) {
+	// tasks are in init order, so dependencies always come before dependents;
+	// initsched_run() relies on this to avoid deadlocks
+	int nscans = 0;
+	for (int i = 0; i < nfeatures; ++i) {
+		s16 mod = feat_initorder[i];
+		if (mod_flags[mod] & HAS_SCAN) scanidx[mod] = ++nscans;
+	}
+	if (!nscans) return false;
+	for (int i = 0; i < nfeatures; ++i) {
+		s16 mod = feat_initorder[i];
+		if (!scanidx[mod]) continue;
+		memset(scanseen, 0, sizeof(scanseen));
+		if_cold (fprintf(out, "static const s16 _scandeps_%.*s[] = {",
+				mod_names[mod].len, mod_names[mod].s) < 0) {
+			diewrite();
+		}
+		// N.B. a zero-length array isn't valid C, so pad with a dummy entry
+		if (!scandeps(out, mod, 0) && fputs("0", out) < 0) diewrite();
+		if_cold (fputs("};\n", out) < 0) diewrite();
+	}
+_( "")
+_( "static struct initsched_task _scantasks[] = {")
+	for (int i = 0; i < nfeatures; ++i) {
+		s16 mod = feat_initorder[i];
+		if (!scanidx[mod]) continue;
+		memset(scanseen, 0, sizeof(scanseen));
+		int ndeps = scandeps(0, mod, 0);
+F( "	{&_feat_scan_%.*s, _scandeps_%.*s, %d},",
+		mod_names[mod].len, mod_names[mod].s,
+		mod_names[mod].len, mod_names[mod].s, ndeps)
+	}
+_( "};")
+_( "")
+_( "static inline void scanfeatures() {")
+	for (int i = 0; i < nfeatures; ++i) {
+		s16 mod = feat_initorder[i];
+		if (!scanidx[mod]) continue;
+		if_cold (fputs("\tif (", out) < 0) diewrite();
+		scanconds(out, mod);
+		// PRESCAN, if any, does its main-thread lookups right here, and gets
+		// to veto the SCAN if there turns out to be nothing to scan
+		if (mod_flags[mod] & HAS_PRESCAN) {
+F( ") _scantasks[%d].enabled = _feat_prescan_%.*s();", scanidx[mod] - 1,
+		mod_names[mod].len, mod_names[mod].s)
+		}
+		else {
+F( ") _scantasks[%d].enabled = true;", scanidx[mod] - 1)
+		}
+	}
+_( "	LOADPROF_BEGIN(\"SCAN\");")
+F( "	initsched_run(_scantasks, %d);", nscans)
+_( "	LOADPROF_END();")
+_( "}")
+_( "")
+	return true;
+}
+
 static inline void gencode(FILE *out, s16 modnames, s16 featdescs) {
 	for (int i = 1; i < nmods; ++i) {
 		if (mod_flags[i] & HAS_INIT) {
@@ -697,6 +885,12 @@ F( "extern int _feat_preinit_%.*s();", mod_names[i].len, mod_names[i].s)
 		if (mod_flags[i] & HAS_END) {
 F( "extern void _feat_end_%.*s();", mod_names[i].len, mod_names[i].s)
 		}
+		if (mod_flags[i] & HAS_SCAN) {
+F( "extern void _feat_scan_%.*s();", mod_names[i].len, mod_names[i].s)
+		}
+		if (mod_flags[i] & HAS_PRESCAN) {
+F( "extern bool _feat_prescan_%.*s();", mod_names[i].len, mod_names[i].s)
+		}
 	}
 _( "")
 _( "static struct {")
@@ -731,6 +925,30 @@ F( "#define has_%.*s (feats._has_%.*s)",
 		mod_names[i].len, mod_names[i].s, mod_names[i].len, mod_names[i].s)
 		}
 	}
+_( "")
+	// gamedata can get folded into constants differently in each of these, so
+	// engineapi.c needs them to know which entries it's safe to override
+_( "const int _gamedata_feattaglist[] = {")
+	int nfeattags = 0;
+	for (int i = 1; i < nmods; ++i) {
+		struct cmeta_slice tag = mod_gamespecific[i];
+		if (!tag.s) continue;
+		for (int j = 1; j < i; ++j) {
+			struct cmeta_slice other = mod_gamespecific[j];
+			if (other.s && other.len == tag.len &&
+					!memcmp(other.s, tag.s, tag.len)) {
+				goto dupe;
+			}
+		}
+F( "	_gametype_tag_%.*s,", tag.len, tag.s)
+		++nfeattags;
+dupe:;
+	}
+	if (!nfeattags) {
+_( "	0 // (avoid an empty array)")
+	}
+_( "};")
+F( "const int _gamedata_nfeattags = %d;", nfeattags)
 _( "")
 	for (int i = 1; i < ncvars; ++i) {
 F( "extern struct con_var *%.*s;", cvar_names[i].len, cvar_names[i].s);
@@ -742,12 +960,14 @@ _( "")
 _( "static inline void preinitfeatures() {")
 	for (int i = 1; i < nmods; ++i) {
 		if (mod_flags[i] & HAS_PREINIT) {
-F( "	feats.preinit_%.*s = _feat_preinit_%.*s();",
+F( "	feats.preinit_%.*s = LOADPROF_INT(\"PREINIT %.*s\",",
 		mod_names[i].len, mod_names[i].s, mod_names[i].len, mod_names[i].s)
+F( "			_feat_preinit_%.*s());", mod_names[i].len, mod_names[i].s)
 		}
 	}
 _( "}")
 _( "")
+	bool hasscans = genscans(out);
 _( "static inline void initfeatures() {")
 	// note: hidden flag could be 0 on OE but it's useful to know which things
 	// *would* be hidden. in particular, GetHelpText currently checks for both
@@ -756,6 +976,9 @@ _( "static inline void initfeatures() {")
 	// is otherwise unused in OE so won't do any harm being set all the time.
 _( "	int _hiddenflag = GAMETYPE_MATCHES(OE) ?")
 _( "			CON_INIT_HIDDEN : _CON_NE_HIDDEN;")
+	if (hasscans) {
+_( "	scanfeatures();")
+	}
 	for (int i = 0; i < nfeatures; ++i) { // N.B.: this *should* be 0-indexed!
 		const char *else_ = "";
 		s16 mod = feat_initorder[i];
@@ -799,16 +1022,19 @@ F( "	%sif (status_%.*s != FEAT_OK) status_%.*s = REQFAIL;", else_,
 			else_ = "else ";
 		}
 		if (mod_flags[mod] & (HAS_END | HAS_EVENTS | HAS_OPTDEPS)) {
-F( "	%sif ((status_%.*s = _feat_init_%.*s()) == FEAT_OK) has_%.*s = true;",
-		else_,
-		mod_names[mod].len, mod_names[mod].s,
+F( "	%sif ((status_%.*s = LOADPROF_INT(\"INIT %.*s\",", else_,
 		mod_names[mod].len, mod_names[mod].s,
 		mod_names[mod].len, mod_names[mod].s)
+F( "			_feat_init_%.*s())) == FEAT_OK) {",
+		mod_names[mod].len, mod_names[mod].s)
+F( "		has_%.*s = true;", mod_names[mod].len, mod_names[mod].s)
+_( "	}")
 		}
 		else {
-F( "	%sstatus_%.*s = _feat_init_%.*s();", else_,
+F( "	%sstatus_%.*s = LOADPROF_INT(\"INIT %.*s\",", else_,
 		mod_names[mod].len, mod_names[mod].s,
 		mod_names[mod].len, mod_names[mod].s)
+F( "			_feat_init_%.*s());", mod_names[mod].len, mod_names[mod].s)
 		}
 	}
 _( "")
@@ -883,6 +1109,19 @@ F( "	memmove(&%.*s->v1, &%.*s->v2, sizeof(struct con_var_common));",
 _( "#endif")
 _( "}")
 	for (int i = 1; i < nevents; ++i) {
+		// when built with SST_EVPROF, each handler call is counted and timed.
+		// see evprof.h; with that turned off, EVPROF_* just expand to the call
+		if (event_handlers[i].hdr.sz) {
+_( "")
+_( "#ifdef SST_EVPROF")
+F( "static struct evprof_handler _evprof_%.*s[] = {",
+		event_names[i].len, event_names[i].s)
+			list_foreach(s16, mod, event_handlers + i) {
+F( "	{\"%.*s\"},", mod_names[mod].len, mod_names[mod].s)
+			}
+_( "};")
+_( "#endif")
+		}
 		const char *prefix = event_predicateflags[i] ?
 				"bool CHECK_" : "void EMIT_";
 		if_cold (fprintf(out, "\n%s%.*s", prefix,
@@ -890,6 +1129,7 @@ _( "}")
 			diewrite();
 		}
 		evargs(out, i, ") {\n");
+		int idx = 0;
 		list_foreach(s16, mod, event_handlers + i) {
 			const char *type = event_predicateflags[i] ? "bool" : "void";
 			if_cold (fprintf(out, "\t%s _evhandler_%.*s_%.*s", type,
@@ -908,12 +1148,14 @@ _( "}")
 				else if_cold (fputs("\tif (!", out) < 0) {
 					diewrite();
 				}
-				if_cold (fprintf(out, "_evhandler_%.*s_%.*s",
+				if_cold (fprintf(out, "EVPROF_CHECK(_evprof_%.*s + %d, "
+						"_evhandler_%.*s_%.*s",
+						event_names[i].len, event_names[i].s, idx,
 						mod_names[mod].len, mod_names[mod].s,
 						event_names[i].len, event_names[i].s) < 0) {
 					diewrite();
 				}
-				evargs_notype(out, i, ")) return false;\n");
+				evargs_notype(out, i, "))) return false;\n");
 			}
 			else {
 				if_cold (fputc('\t', out) < 0) diewrite();
@@ -923,26 +1165,118 @@ _( "}")
 						diewrite();
 					}
 				}
-				if_cold (fprintf(out, "_evhandler_%.*s_%.*s",
+				if_cold (fprintf(out, "EVPROF_CALL(_evprof_%.*s + %d, "
+						"_evhandler_%.*s_%.*s",
+						event_names[i].len, event_names[i].s, idx,
 						mod_names[mod].len, mod_names[mod].s,
 						event_names[i].len, event_names[i].s) < 0) {
 					diewrite();
 				}
-				evargs_notype(out, i, ");\n");
+				evargs_notype(out, i, "));\n");
 			}
+			++idx;
 		}
 		if (event_predicateflags[i]) {
 _( "	return true;")
 		}
 _( "}")
 	}
+_( "")
+_( "#ifdef SST_EVPROF")
+_( "const struct evprof_event evprof_events[] = {")
+	int nprofevents = 0;
+	for (int i = 1; i < nevents; ++i) {
+		if (!event_handlers[i].hdr.sz) continue;
+		int n = 0;
+		list_foreach(s16, mod, event_handlers + i) ++n;
+F( "	{\"%.*s\", _evprof_%.*s, %d},",
+		event_names[i].len, event_names[i].s,
+		event_names[i].len, event_names[i].s, n)
+		++nprofevents;
+	}
+_( "};")
+F( "const int evprof_nevents = %d;", nprofevents)
+_( "#endif")
 }
 
-int OS_MAIN(int argc, os_char *argv[]) {
+// scanning source files is by far the slowest part of all this, thanks largely
+// to the chibicc tokeniser, so that gets farmed out to a bunch of threads. each
+// file gets its own cmeta (and the tokeniser's allocations are per-thread), and
+// everything after that is done serially in argv order, meaning the output is
+// the same regardless of how the scanning happens to get scheduled.
+#define MAX_THREADS 64
+static SHUNT(struct cmeta, mod_cmetas)[MAX_MODULES];
+static os_char **scan_files;
+static _Atomic int scan_next = 1;
+
+static void scanfiles() {
+	for (int i; i = atomic_fetch_add_explicit(&scan_next, 1,
+			memory_order_relaxed), i < nmods;) {
+		mod_cmetas[i] = cmeta_loadfile(scan_files[i]);
+	}
+}
+
+#ifdef _WIN32
+static ulong __stdcall scanthrmain(void *unused) { scanfiles(); return 0; }
+#else
+static void *scanthrmain(void *unused) { scanfiles(); return 0; }
+#endif
+
+static int ncpus() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#endif
+}
+
+static void scanall(os_char *files[], int nthreads) {
+	scan_files = files;
+	if (nthreads > nmods - 1) nthreads = nmods - 1;
+	if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+	// the main thread does its share of the work too, so spawn one fewer. if
+	// spawning fails, that's fine, the remaining threads just do more work.
+	int nspawned = 0;
+#ifdef _WIN32
+	void *thrs[MAX_THREADS];
+	for (; nspawned < nthreads - 1; ++nspawned) {
+		thrs[nspawned] = CreateThread(0, 0, &scanthrmain, 0, 0, 0);
+		if (!thrs[nspawned]) break;
+	}
+	scanfiles();
+	if (nspawned && WaitForMultipleObjects(nspawned, thrs, true, INFINITE) ==
+			WAIT_FAILED) {
+		die(100, "couldn't wait for scanner threads");
+	}
+#else
+	pthread_t thrs[MAX_THREADS];
+	for (; nspawned < nthreads - 1; ++nspawned) {
+		if (pthread_create(thrs + nspawned, 0, &scanthrmain, 0)) break;
+	}
+	scanfiles();
+	for (int i = 0; i < nspawned; ++i) {
+		if_cold (pthread_join(thrs[i], 0)) {
+			die(100, "couldn't wait for scanner threads");
+		}
+	}
+#endif
+}
+
+/*
+ * Does all the actual work. nthreads is the maximum number of threads to use
+ * for scanning source files; 1 means do everything sequentially on the calling
+ * thread. Can only be called once per process as it uses a ton of global state.
+ */
+static void gluegen(int argc, os_char *argv[], int nthreads,
+		const char *outpath) {
 	s16 modlookup = 0, featdesclookup = 0, eventlookup = 0;
 	if_cold (argc > MAX_MODULES) {
 		die(2, "too many files passed - increase MAX_MODULES in gluegen.c!");
 	}
+	arena_init();
 	nmods = argc;
 	for (int i = 1; i < nmods; ++i) {
 		const os_char *f = argv[i];
@@ -980,9 +1314,10 @@ int OS_MAIN(int argc, os_char *argv[]) {
 			diefile(2, f, 0, "duplicate module name");
 		}
 	}
+	scanall(argv, nthreads);
 	for (int i = 1; i < nmods; ++i) {
-		struct cmeta cm = cmeta_loadfile(argv[i]);
-		handle(i, modlookup, &featdesclookup, &eventlookup, argv[i], &cm);
+		handle(i, modlookup, &featdesclookup, &eventlookup, argv[i],
+				mod_cmetas + i);
 	}
 	// double check that events are defined. the compiler would also catch this,
 	// but we can do it faster and with arguably more helpful error information.
@@ -995,11 +1330,18 @@ int OS_MAIN(int argc, os_char *argv[]) {
 	}
 	sortfeatures();
 
-	FILE *out = fopen(".build/include/glue.gen.h", "wb");
-	if_cold (!out) die(100, "couldn't open .build/include/glue.gen.h");
+	FILE *out = fopen(outpath, "wb");
+	if_cold (!out) {
+		fprintf(stderr, "gluegen: fatal: couldn't open %s\n", outpath);
+		exit(100);
+	}
 	H()
 	gencode(out, modlookup, featdesclookup);
 	if_cold (fflush(out)) die(100, "couldn't finish writing output");
+}
+
+int OS_MAIN(int argc, os_char *argv[]) {
+	gluegen(argc, argv, ncpus(), ".build/include/glue.gen.h");
 	return 0;
 }
 
@@ -0,0 +1,361 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../intdefs.h"
+#include "../langext.h"
+#include "../os.h"
+
+#ifdef _WIN32
+#define fS "S"
+#else
+#define fS "s"
+#endif
+
+static cold noreturn die(int status, const char *s) {
+	fprintf(stderr, "mkcutscenes: fatal: %s\n", s);
+	exit(status);
+}
+static cold noreturn dieparse(const os_char *file, int line, const char *s) {
+	fprintf(stderr, "mkcutscenes: %" fS ":%d: %s\n", file, line, s);
+	exit(2);
+}
+
+static char *sbase; // input file contents - names are pointers into this
+
+#define MAXCAMPAIGNS 1024
+// per campaign. l4dreset.c queues up to 2n + 1 fastfwd segments for a cutscene
+// with n segments (including the initial delay), and fastfwd.c's queue holds
+// 64, so leave a little room to spare. still way more than any would need.
+#define MAXSEGS ((64 - 2) / 2)
+static struct campaign {
+	const char *name;
+	int game; // 1 or 2, for L4D1 or L4D2
+	int nsegs;
+	schar segs[MAXSEGS + 1]; // encoded as in the output (see doffsegs())
+	int idx; // index of the encoded segments in the output array
+	u32 hash;
+} campaigns[MAXCAMPAIGNS];
+static int ncampaigns = 0;
+
+// N.B. these must match the functions emitted in dohash() below! the first is
+// FNV-1a with the game mixed in first, the second is a standard integer
+// finaliser to spread that out so different displacements give unrelated slots
+static u32 hash(int game, const char *s) {
+	u32 h = (0x811C9DC5 ^ game) * 0x01000193;
+	for (; *s; ++s) h = (h ^ (uchar)*s) * 0x01000193;
+	return h;
+}
+static u32 mix(u32 h, u32 disp) {
+	h ^= disp * 0x9E3779B9;
+	h ^= h >> 16; h *= 0x7FEB352D;
+	h ^= h >> 15; h *= 0x846CA68B;
+	h ^= h >> 16;
+	return h;
+}
+
+static int parsenum(char **p) {
+	int ret = 0;
+	if (**p < '0' || **p > '9') return -1;
+	for (; **p >= '0' && **p <= '9'; ++*p) {
+		ret = ret * 10 + **p - '0';
+		if (ret > 255) return -1;
+	}
+	return ret;
+}
+
+static inline void handleentry(char *p, int game, const os_char *file,
+		int line) {
+	if_cold (!game) dieparse(file, line, "campaign not under a game heading");
+	if_cold (ncampaigns == MAXCAMPAIGNS) die(2, "too many campaigns");
+	struct campaign *c = campaigns + ncampaigns++;
+	c->game = game;
+	c->name = p;
+	while (*p && *p != ' ' && *p != '\t') ++p;
+	if_cold (!*p) dieparse(file, line, "campaign has no timings");
+	*p++ = '\0';
+	for (int i = 0; i < ncampaigns - 1; ++i) {
+		if_cold (campaigns[i].game == game && !strcmp(campaigns[i].name,
+				c->name)) {
+			dieparse(file, line, "duplicate campaign name");
+		}
+	}
+	c->nsegs = 0;
+	for (;;) {
+		while (*p == ' ' || *p == '\t') ++p;
+		if (!*p) break;
+		int secs = parsenum(&p), extra = 0;
+		if_cold (secs < 1 || secs > 127) {
+			dieparse(file, line, "segment length must be from 1 to 127");
+		}
+		if (*p == '-') {
+			++p;
+			int max = parsenum(&p);
+			if_cold (max <= secs || max - secs > 127) {
+				dieparse(file, line, "invalid length range");
+			}
+			extra = max - secs;
+		}
+		if_cold (*p && *p != ' ' && *p != '\t') {
+			dieparse(file, line, "invalid segment length");
+		}
+		if_cold (c->nsegs && c->segs[c->nsegs] != 0) {
+			dieparse(file, line, "only the last segment can have a range");
+		}
+		if_cold (c->nsegs == MAXSEGS) dieparse(file, line, "too many segments");
+		c->segs[c->nsegs++] = secs;
+		c->segs[c->nsegs] = extra; // overwritten if there's another segment
+	}
+	if_cold (!c->nsegs) dieparse(file, line, "campaign has no timings");
+	c->segs[c->nsegs - 1] = -c->segs[c->nsegs - 1];
+	c->hash = hash(game, c->name);
+}
+
+static inline void parse(const os_char *file, int len) {
+	char *s = sbase; // for convenience
+	if_cold (s[len - 1] != '\n') {
+		dieparse(file, 0, "invalid text file (missing EOL)");
+	}
+	int game = 0;
+	for (int i = 0, line = 1; i < len; ++line) {
+		char *p = s + i, *end = memchr(p, '\n', len - i);
+		i = end - s + 1;
+		if_cold (memchr(p, '\0', end - p)) {
+			dieparse(file, line, "unexpected null byte");
+		}
+		char *comment = memchr(p, '#', end - p);
+		if (comment) end = comment;
+		while (end > p && (end[-1] == ' ' || end[-1] == '\t' ||
+				end[-1] == '\r')) {
+			--end;
+		}
+		*end = '\0';
+		if (*p == ' ' || *p == '\t') {
+			while (*p == ' ' || *p == '\t') ++p;
+			if (*p) handleentry(p, game, file, line);
+		}
+		else if (*p) {
+			if (!strcmp(p, "L4D1")) game = 1;
+			else if (!strcmp(p, "L4D2")) game = 2;
+			else dieparse(file, line, "expected L4D1 or L4D2 heading");
+		}
+	}
+}
+
+// all the campaigns' segments go in one array, with any that are identical to
+// the end of another one sharing its bytes, to keep things nice and compact
+#define MAXOUTSEGS 32767
+static schar outsegs[MAXOUTSEGS];
+static bool segstart[MAXOUTSEGS]; // where a campaign's segments could start
+static int noutsegs = 0;
+
+static int cmplen(const void *a, const void *b) {
+	const struct campaign *const *x = a, *const *y = b;
+	return (*y)->nsegs - (*x)->nsegs;
+}
+
+static inline void packsegs() {
+	// longest first, so shorter ones have the best chance of sharing
+	static struct campaign *sorted[MAXCAMPAIGNS];
+	for (int i = 0; i < ncampaigns; ++i) sorted[i] = campaigns + i;
+	qsort(sorted, ncampaigns, sizeof(*sorted), &cmplen);
+	for (int i = 0; i < ncampaigns; ++i) {
+		struct campaign *c = sorted[i];
+		int n = c->nsegs + 1; // including the extra length byte
+		for (int j = 0; j + n <= noutsegs; ++j) {
+			if (segstart[j] && !memcmp(outsegs + j, c->segs, n)) {
+				c->idx = j;
+				goto next;
+			}
+		}
+		if_cold (noutsegs + n > MAXOUTSEGS) die(2, "too many segments");
+		c->idx = noutsegs;
+		memcpy(outsegs + noutsegs, c->segs, n);
+		for (int j = 0; j < c->nsegs; ++j) segstart[noutsegs + j] = true;
+		noutsegs += n;
+next:;
+	}
+}
+
+// perfect hashing, using the "hash and displace" approach: keys are split into
+// buckets by their hash, and each bucket gets a displacement value which
+// scatters its keys into free slots of the actual table. buckets are placed
+// biggest first, since those are the hardest to fit.
+static int tablesz, nbuckets;
+static short slots[MAXCAMPAIGNS * 4]; // index into campaigns, or -1
+static u16 disps[MAXCAMPAIGNS];
+static struct bucket { int n; short keys[MAXCAMPAIGNS]; } *buckets;
+static int order[MAXCAMPAIGNS]; // bucket indices, biggest bucket first
+
+static int cmpbucket(const void *a, const void *b) {
+	const int *x = a, *y = b;
+	return buckets[*y].n - buckets[*x].n;
+}
+
+static bool tryplace(const struct bucket *b, u32 disp) {
+	for (int i = 0; i < b->n; ++i) {
+		u32 slot = mix(campaigns[b->keys[i]].hash, disp) & tablesz - 1;
+		if (slots[slot] != -1) {
+			for (int j = 0; j < i; ++j) {
+				slots[mix(campaigns[b->keys[j]].hash, disp) & tablesz - 1] = -1;
+			}
+			return false;
+		}
+		slots[slot] = b->keys[i];
+	}
+	return true;
+}
+
+static bool trytable() {
+	for (int i = 0; i < tablesz; ++i) slots[i] = -1;
+	for (int i = 0; i < nbuckets; ++i) { buckets[i].n = 0; order[i] = i; }
+	for (int i = 0; i < ncampaigns; ++i) {
+		struct bucket *b = buckets + (mix(campaigns[i].hash, 0) & nbuckets - 1);
+		b->keys[b->n++] = i;
+	}
+	qsort(order, nbuckets, sizeof(*order), &cmpbucket);
+	for (int i = 0; i < nbuckets; ++i) {
+		const struct bucket *b = buckets + order[i];
+		u32 disp = 0;
+		if (b->n) while (!tryplace(b, disp)) {
+			if (++disp == 65536) return false;
+		}
+		disps[order[i]] = disp;
+	}
+	return true;
+}
+
+static inline void dohash() {
+	for (int i = 0; i < ncampaigns; ++i) {
+		for (int j = 0; j < i; ++j) {
+			if_cold (campaigns[i].hash == campaigns[j].hash) {
+				die(2, "campaign name hash collision");
+			}
+		}
+	}
+	buckets = malloc(MAXCAMPAIGNS * sizeof(*buckets));
+	if_cold (!buckets) die(100, "couldn't allocate memory");
+	// start at a load factor of at least 0.5 and about 4 keys per bucket, and
+	// get more generous if that doesn't work out
+	for (tablesz = 2; tablesz < ncampaigns * 2; tablesz <<= 1);
+	for (;;) {
+		nbuckets = tablesz / 8 ? tablesz / 8 : 1;
+		if (trytable()) break;
+		if_cold ((tablesz <<= 1) > countof(slots)) {
+			die(2, "couldn't find a perfect hash for the campaign names");
+		}
+	}
+	free(buckets);
+}
+
+static cold noreturn diewrite() { die(100, "couldn't write to file"); }
+#define _(x) if_cold (fprintf(out, "%s\n", x) < 0) diewrite();
+#define F(f, ...) if_cold (fprintf(out, f "\n", __VA_ARGS__) < 0) diewrite();
+#define H() \
+_("/* This file is autogenerated by src/build/mkcutscenes.c. DO NOT EDIT! */") \
+_( "")
+
+static inline void doffsegs(FILE *out) {
+_( "// Encoding: seconds to each point of interest, with the last one negated")
+_( "// and followed by the extra time it can randomly take (usually 0).")
+_( "static const schar ffsegs[] = {")
+	for (int i = 0; i < noutsegs; i += 16) {
+		if_cold (fputc('\t', out) == EOF) diewrite();
+		for (int j = i; j < i + 16 && j < noutsegs; ++j) {
+			if_cold (fprintf(out, "%d,%s", outsegs[j],
+					j + 1 < i + 16 && j + 1 < noutsegs ? " " : "") < 0) {
+				diewrite();
+			}
+		}
+		if_cold (fputc('\n', out) == EOF) diewrite();
+	}
+_( "};")
+_( "")
+}
+
+static inline void dotable(FILE *out) {
+F( "#define FFCAMPAIGNS_MASK %d", tablesz - 1)
+F( "#define FFDISPS_MASK %d", nbuckets - 1)
+_( "")
+_( "static const u16 ffdisps[] = {")
+	for (int i = 0; i < nbuckets; i += 8) {
+		if_cold (fputc('\t', out) == EOF) diewrite();
+		for (int j = i; j < i + 8 && j < nbuckets; ++j) {
+			if_cold (fprintf(out, "%d,%s", disps[j],
+					j + 1 < i + 8 && j + 1 < nbuckets ? " " : "") < 0) {
+				diewrite();
+			}
+		}
+		if_cold (fputc('\n', out) == EOF) diewrite();
+	}
+_( "};")
+_( "")
+_( "static const struct {")
+_( "	const char *name;")
+_( "	uchar game;")
+_( "	u16 idx;")
+_( "} ffcampaigns[] = {")
+	for (int i = 0; i < tablesz; ++i) {
+		if (slots[i] == -1) continue;
+		const struct campaign *c = campaigns + slots[i];
+F( "	[%d] = {\"%s\", %d, %d},", i, c->name, c->game, c->idx)
+	}
+	// make sure the array covers the whole table, even if the end is empty
+	if (slots[tablesz - 1] == -1) F( "	[%d] = {0}", tablesz - 1)
+_( "};")
+_( "")
+_( "static inline u32 ffcampaign_hash(int game, const char *s) {")
+_( "	u32 h = (0x811C9DC5 ^ game) * 0x01000193;")
+_( "	for (; *s; ++s) h = (h ^ (uchar)*s) * 0x01000193;")
+_( "	return h;")
+_( "}")
+_( "")
+_( "static inline u32 ffcampaign_mix(u32 h, u32 disp) {")
+_( "	h ^= disp * 0x9E3779B9;")
+_( "	h ^= h >> 16; h *= 0x7FEB352D;")
+_( "	h ^= h >> 15; h *= 0x846CA68B;")
+_( "	h ^= h >> 16;")
+_( "	return h;")
+_( "}")
+}
+
+int OS_MAIN(int argc, os_char *argv[]) {
+	if_cold (argc != 2) die(1, "wrong number of arguments");
+	int f = os_open_read(argv[1]);
+	if_cold (f == -1) die(100, "couldn't open file");
+	vlong len = os_fsize(f);
+	if_cold (len > 1u << 30 - 1) die(2, "input file is far too large");
+	sbase = malloc(len);
+	if_cold (!sbase) die(100, "couldn't allocate memory");
+	if_cold (os_read(f, sbase, len) != len) die(100, "couldn't read file");
+	os_close(f);
+	parse(argv[1], len);
+	if_cold (!ncampaigns) die(2, "no campaigns defined");
+	packsegs();
+	dohash();
+
+	FILE *out = fopen(".build/include/l4dcutscenes.gen.h", "wb");
+	if_cold (!out) die(100, "couldn't open l4dcutscenes.gen.h");
+	H();
+	doffsegs(out);
+	dotable(out);
+	return 0;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
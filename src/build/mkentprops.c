@@ -40,122 +40,64 @@ static cold noreturn dieparse(const os_char *file, int line, const char *s) {
 
 static char *sbase; // input file contents - string values are indices off this
 
-// custom data structure of the day: zero-alloc half-SoA adaptive radix trees(!)
+// the props we want form a tree: ServerClasses at the top, then SendProps,
+// with nested SendTables as needed. each level is just a list of siblings,
+// since we only ever look things up at build time and the lists are tiny.
 
-#define ART_MAXNODES 16384
-static uchar art_firstbytes[ART_MAXNODES];
-static struct art_core {
-	int soff; // string offset to entire key chunk (including firstbyte)
-	u16 slen; // number of bytes in key chunk (including firstbyte, >=1)
-	u16 next; // sibling node (same prefix, different firstbyte)
-} art_cores[ART_MAXNODES];
-// if node doesn't end in \0: child node (i.e. key appends more bytes)
-// if node DOES end in \0: offset into art_leaves (below)
-static u16 art_children[ART_MAXNODES];
-static int art_nnodes = 0;
-
-#define ART_NULL ((u16)-1)
-
-static inline int art_newnode() {
-	if_cold (art_nnodes == ART_MAXNODES) die(2, "out of tree nodes");
-	return art_nnodes++;
-}
-
-#define ART_MAXLEAVES 8192
-static struct art_leaf {
+#define MAXNODES 16384
+static struct node {
+	int name; // string offset of this part of the network name
 	int varstr; // offset of string (generated variable), if any, or -1 if none
-	u16 subtree; // art index of subtree (nested SendTable), or -1 if none
-	u16 nsubs; // number of subtrees (used to short-circuit the runtime search)
-} art_leaves[ART_MAXLEAVES];
-static int art_nleaves = 0;
-static u16 art_root = ART_NULL; // ServerClasses (which point at SendTables)
-static u16 nclasses = 0; // similar short circuit for ServerClasses
+	u32 hash; // of the name, which is what the generated code switches on
+	u16 child; // first child (props in table), if any, or -1 if none
+	u16 next; // next sibling, or -1 if none
+	u16 nchildren; // number of children (used to short-circuit runtime search)
+} nodes[MAXNODES];
+static int nnodes = 0;
 
+#define NODE_NULL ((u16)-1)
 #define VAR_NONE -1
 
-// for quick iteration over var names to generate decls header without ART faff
+static u16 root = NODE_NULL; // ServerClasses (which point at SendTables)
+static u16 nclasses = 0; // similar short circuit for ServerClasses
+
+// for quick iteration over var names to generate decls header without tree faff
 #define MAXDECLS 4096
 static int decls[MAXDECLS];
 static int ndecls = 0;
 
-static inline int art_newleaf() {
-	if_cold (art_nleaves == ART_MAXLEAVES) die(2, "out of leaf nodes");
-	return art_nleaves++;
+// FNV-1a - nothing fancy, the names are short and we only need to avoid
+// collisions among the ones we're looking for, not the whole game's worth.
+// N.B. must match the hash function emitted in doinit() below!
+static u32 hash(const char *s) {
+	u32 h = 0x811C9DC5;
+	for (; *s; ++s) h = (h ^ (uchar)*s) * 0x01000193;
+	return h;
 }
 
-static struct art_lookup_ret {
-	bool isnew; // true if node created, false if found
-	u16 leafidx; // index of value (leaf) node
-} art_lookup(u16 *art, int soff, int len) {
-	assume(len > 0); // everything must be null-terminated!
-	for (;;) {
-		const uchar *p = (const uchar *)sbase + soff;
-		u16 cur = *art;
-		if (cur == ART_NULL) { // append
-			int new = art_newnode();
-			*art = new;
-			art_firstbytes[new] = *p;
-			art_cores[new].soff = soff;
-			art_cores[new].slen = len;
-			art_cores[new].next = ART_NULL;
-			int leaf = art_newleaf(); // N.B. firstbyte is already 0 here
-			art_children[new] = leaf;
-			return (struct art_lookup_ret){true, leaf};
-		}
-		while (art_firstbytes[cur] == *p) {
-			int nodelen = art_cores[cur].slen;
-			int matchlen = 1;
-			const uchar *q = (const uchar *)sbase + art_cores[cur].soff;
-			for (; matchlen < nodelen; ++matchlen) {
-				if (p[matchlen] != q[matchlen]) {
-					// node and key diverge: split into child nodes
-					// (left is new part of key string, right is existing tail)
-					art_cores[cur].slen = matchlen;
-					int l = art_newnode(), r = art_newnode();
-					art_firstbytes[l] = p[matchlen];
-					art_cores[l].soff = soff + matchlen;
-					art_cores[l].slen = len - matchlen;
-					art_cores[l].next = r;
-					art_firstbytes[r] = q[matchlen];
-					art_cores[r].soff = art_cores[cur].soff + matchlen;
-					art_cores[r].slen = nodelen - matchlen;
-					art_cores[r].next = ART_NULL;
-					art_children[r] = art_children[cur];
-					art_children[cur] = l;
-					int leaf = art_newleaf();
-					art_children[l] = leaf;
-					return (struct art_lookup_ret){true, leaf};
-				}
-			}
-			if (matchlen == len) {
-				// node matches entire key: we have matched an existing entry
-				return (struct art_lookup_ret){false, art_children[cur]};
-			}
-			// node is substring of key: descend into child nodes
-			soff += matchlen;
-			len -= matchlen;
-			cur = art_children[cur]; // note: this can't be ART_NULL (thus loop)
-			p = (const uchar *)sbase + soff; // XXX: kinda silly dupe
+static struct node *getnode(u16 *list, const char *s, const os_char *parsefile,
+		int parseline, u16 *countvar) {
+	for (; *list != NODE_NULL; list = &nodes[*list].next) {
+		struct node *n = nodes + *list;
+		if (strcmp(sbase + n->name, s)) continue;
+		// if parsefile is null then we don't care about dupes (subtable)
+		if (parsefile) if_cold (n->varstr != VAR_NONE) {
+			dieparse(parsefile, parseline, "duplicate property name");
 		}
-		// if we didn't match this node, try the next sibling node.
-		// if sibling is null, we'll hit the append case above.
-		art = &art_cores[cur].next;
+		return n;
 	}
-}
-
-static struct art_leaf *helpgetleaf(u16 *art, const char *s, int len,
-		const os_char *parsefile, int parseline, u16 *countvar) {
-	struct art_lookup_ret leaf = art_lookup(art, s - sbase, len);
-	if (leaf.isnew) {
-		art_leaves[leaf.leafidx].varstr = VAR_NONE;
-		art_leaves[leaf.leafidx].subtree = ART_NULL;
-		++*countvar;
-	}
-	// if parsefile is null then we don't care about dupes (looking at subtable)
-	else if (parsefile) if_cold (art_leaves[leaf.leafidx].varstr != VAR_NONE) {
-		dieparse(parsefile, parseline, "duplicate property name");
-	}
-	return art_leaves + leaf.leafidx;
+	// not found: append, so that the generated code follows the file order
+	if_cold (nnodes == MAXNODES) die(2, "out of tree nodes");
+	*list = nnodes;
+	struct node *n = nodes + nnodes++;
+	n->name = s - sbase;
+	n->varstr = VAR_NONE;
+	n->hash = hash(s);
+	n->child = NODE_NULL;
+	n->next = NODE_NULL;
+	n->nchildren = 0;
+	++*countvar;
+	return n;
 }
 
 static inline void handleentry(char *k, char *v, int vlen,
@@ -167,29 +109,18 @@ static inline void handleentry(char *k, char *v, int vlen,
 		dieparse(file, line, "network name not in class/property format");
 	}
 	*propname++ = '\0';
-	int sublen = propname - v;
-	if_cold (sublen > 65535) {
-		dieparse(file, line, "network class name is far too long");
-	}
-	vlen -= sublen;
-	struct art_leaf *leaf = helpgetleaf(&art_root, v, sublen, 0, 0, &nclasses);
-	u16 *subtree = &leaf->subtree;
+	vlen -= propname - v;
+	struct node *n = getnode(&root, v, 0, 0, &nclasses);
 	for (;;) {
-		if_cold (vlen > 65535) {
-			dieparse(file, line, "property (SendTable) name is far too long");
-		}
 		char *nextpart = memchr(propname, '/', vlen);
 		if_cold (!nextpart) {
-			leaf = helpgetleaf(subtree, propname, vlen, file, line,
-					&leaf->nsubs);
-			leaf->varstr = k - sbase;
+			n = getnode(&n->child, propname, file, line, &n->nchildren);
+			n->varstr = k - sbase;
 			break;
 		}
 		*nextpart++ = '\0';
-		sublen = nextpart - propname;
-		leaf = helpgetleaf(subtree, propname, sublen, 0, 0, &leaf->nsubs);
-		subtree = &leaf->subtree;
-		vlen -= sublen;
+		vlen -= nextpart - propname;
+		n = getnode(&n->child, propname, 0, 0, &n->nchildren);
 		propname = nextpart;
 	}
 }
@@ -257,94 +188,66 @@ static cold noreturn diewrite() { die(100, "couldn't write to file"); }
 _( "/* This file is autogenerated by src/build/mkentprops.c. DO NOT EDIT! */") \
 _( "")
 
-static void dosendtables(FILE *out, u16 art, int indent) {
-_i("switch (*p) {")
-	while (art != ART_NULL) {
-		// stupid hack: figure out char literal in case of null byte
-		char charlit[3] = {art_firstbytes[art], '0'};
-		if_hot (charlit[0]) charlit[1] = '\0'; else charlit[0] = '\\';
-		if (art_cores[art].slen != 1) {
-			const char *tail = sbase + art_cores[art].soff + 1;
-			int len = art_cores[art].slen - 1;
-Fi("	case '%s': if (!strncmp(p + 1, \"%.*s\", %d)) {",
-charlit, len, tail, len)
-		}
-		else {
-Fi("	case '%s': {", charlit)
-		}
-		int idx = art_children[art];
-		// XXX: kind of a dumb and bad way to distinguish these. okay for now...
-		if (sbase[art_cores[art].soff + art_cores[art].slen - 1] != '\0') {
-Fi("		p += %d;", art_cores[art].slen)
-			dosendtables(out, idx, indent + 2);
-		}
-		else {
-			// XXX: do we actually want to prefetch this before the for loop?
-_i("		int off = baseoff + mem_loads32(mem_offset(sp, off_SP_offset));")
-			if (art_leaves[idx].varstr != VAR_NONE) {
-Fi("		%s = off;", sbase + art_leaves[idx].varstr);
-			}
-			if (art_leaves[idx].subtree != ART_NULL) {
-_i("		if (mem_loads32(mem_offset(sp, off_SP_type)) == DPT_DataTable) {")
-_i("			int baseoff = off;")
-_i("			const struct SendTable *st = mem_loadptr(mem_offset(sp, off_SP_subtable));")
-Fi("			for (int i = 0, need = %d; i < st->nprops && need; ++i) {",
-art_leaves[idx].nsubs + (art_leaves[idx].varstr != -1))
-_i("				const struct SendProp *sp = mem_offset(st->props, sz_SendProp * i);")
-_i("				const char *p = mem_loadptr(mem_offset(sp, off_SP_varname));")
-				dosendtables(out, art_leaves[idx].subtree, indent + 4);
-_i("			}")
-_i("		}")
-			}
-Fi("		--need;")
-		}
-_i("	} break;")
-		art = art_cores[art].next;
+static void dotable(FILE *out, const struct node *n, int indent);
+
+static void doprop(FILE *out, const struct node *n, int indent) {
+_i("int off = baseoff + mem_loads32(mem_offset(sp, off_SP_offset));")
+	if (n->varstr != VAR_NONE) {
+Fi("%s = off;", sbase + n->varstr)
 	}
+	if (n->child != NODE_NULL) {
+_i("const struct SendTable *st = mem_loadptr(mem_offset(sp, off_SP_subtable));")
+		// might not even be a table, but prefetching can't fault, so we can
+		// start pulling it in while still checking the type
+_i("__builtin_prefetch(st);")
+_i("if (mem_loads32(mem_offset(sp, off_SP_type)) == DPT_DataTable) {")
+_i("	int baseoff = off;")
+		dotable(out, n, indent + 1);
 _i("}")
+	}
 }
 
-static void doclasses(FILE *out, u16 art, int indent) {
-_i("switch (*p) {")
-	for (; art != ART_NULL; art = art_cores[art].next) {
-		// stupid hack 2: exact dupe boogaloo
-		char charlit[3] = {art_firstbytes[art], '0'};
-		if_hot (charlit[0]) charlit[1] = '\0'; else charlit[0] = '\\';
-		if (art_cores[art].slen != 1) {
-			const char *tail = sbase + art_cores[art].soff + 1;
-			int len = art_cores[art].slen - 1;
-Fi("	case '%s': if (!strncmp(p + 1, \"%.*s\", %d)) {",
-charlit, len, tail, len)
+static void dolist(FILE *out, u16 list, int indent, bool classes) {
+_i("switch (entprops_hash(p)) {")
+	for (u16 i = list; i != NODE_NULL; i = nodes[i].next) {
+		// group any names whose hashes collide into the first one's case
+		bool first = true;
+		for (u16 j = list; j != i; j = nodes[j].next) {
+			if (nodes[j].hash == nodes[i].hash) { first = false; break; }
 		}
-		else {
-Fi("	case '%s': {", charlit)
-		}
-		int idx = art_children[art];
-		// XXX: same dumb-and-bad-ness as above. there must be a better way!
-		if (sbase[art_cores[art].soff + art_cores[art].slen - 1] != '\0') {
-Fi("		p += %d;", art_cores[art].slen)
-			doclasses(out, art_children[art], indent + 2);
-		}
-		else {
-			assume(art_leaves[idx].varstr == VAR_NONE);
-			assume(art_leaves[idx].subtree != ART_NULL);
-_i("		const struct SendTable *st = class->table;")
-Fi("		for (int i = 0, need = %d; i < st->nprops && need; ++i) {",
-art_leaves[idx].nsubs + (art_leaves[idx].varstr != -1))
-				// note: annoyingly long line here, but the generated code gets
-				// super nested anyway, so there's no point in caring really
-				// XXX: basically a dupe of dosendtables() - fold into above?
-_i("			const struct SendProp *sp = mem_offset(st->props, sz_SendProp * i);")
-_i("			const char *p = mem_loadptr(mem_offset(sp, off_SP_varname));")
-			dosendtables(out, art_leaves[idx].subtree, indent + 3);
+		if (!first) continue;
+Fi("	case 0x%08X:", nodes[i].hash)
+		const char *else_ = "";
+		for (u16 j = i; j != NODE_NULL; j = nodes[j].next) {
+			if (nodes[j].hash != nodes[i].hash) continue;
+			// confirmatory compare - can't trust a hash of arbitrary game data
+Fi("		%sif (!strcmp(p, \"%s\")) {", else_, sbase + nodes[j].name)
+			if (classes) {
+_i("			const struct SendTable *st = class->table;")
+				dotable(out, nodes + j, indent + 3);
+			}
+			else {
+				doprop(out, nodes + j, indent + 3);
+			}
+_i("			--need;")
 _i("		}")
-Fi("		--need;")
+			else_ = "else ";
 		}
-_i("	} break;")
+_i("		break;")
 	}
 _i("}")
 }
 
+static void dotable(FILE *out, const struct node *n, int indent) {
+	// stop as soon as we've got everything we need from this table
+Fi("for (int i = 0, need = %d; i < st->nprops && need; ++i) {", n->nchildren)
+_i("	const struct SendProp *sp = mem_offset(st->props, sz_SendProp * i);")
+_i("	__builtin_prefetch(mem_offset(sp, sz_SendProp)); // next prop")
+_i("	const char *p = mem_loadptr(mem_offset(sp, off_SP_varname));")
+	dolist(out, n->child, indent + 1, false);
+_i("}")
+}
+
 static inline void dodecls(FILE *out) {
 	for (int i = 0; i < ndecls; ++i) {
 		const char *s = sbase + decls[i];
@@ -360,11 +263,18 @@ static inline void doinit(FILE *out) {
 F( "int %s = 0;", s);
 	}
 _( "")
+_( "static inline u32 entprops_hash(const char *s) {")
+_( "	u32 h = 0x811C9DC5;")
+_( "	for (; *s; ++s) h = (h ^ (uchar)*s) * 0x01000193;")
+_( "	return h;")
+_( "}")
+_( "")
 _( "static inline void initentprops(const struct ServerClass *class) {")
 _( "	enum { baseoff = 0 };") // can be shadowed for subtables.
 F( "	for (int need = %d; need && class; class = class->next) {", nclasses)
+_( "		__builtin_prefetch(class->next);")
 _( "		const char *p = class->name;")
-	doclasses(out, art_root, 2);
+	dolist(out, root, 2, true);
 _( "	}")
 _( "}")
 }
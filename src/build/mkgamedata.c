@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../intdefs.h"
 #include "../langext.h"
@@ -82,7 +83,9 @@ static inline void handleentry(char *k, char *v, int indent,
  *			<some-other-nested-conditional-gametype> <expr>
  *
  * The most complicated it can get is if conditionals are nested, which
- * basically translates directly into nested ifs.
+ * basically translates into nested ifs - although these actually get compiled
+ * into a flat table of rules (see init() below) rather than literal code.
+ * Because of that, game-specific values must be constant expressions.
  *
  * Just be aware that whitespace is significant, and you have to use tabs.
  * Any and all future complaints about that decision SHOULD - and MUST - be
@@ -191,6 +194,114 @@ F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
 	}
 }
 
+// each distinct conditional (tag, or !tag) gets a bit in a mask, so that each
+// nested rule is just a set of bits that all have to match
+static int condtags[64];
+static int nconds = 0;
+
+static int condbit(int i) {
+	for (int j = 0; j < nconds; ++j) {
+		if (!strcmp(sbase + condtags[j], sbase + tags[i])) return j;
+	}
+	if_cold (nconds == countof(condtags)) {
+		dieparse(srcfiles[i], srclines[i],
+				"too many distinct conditionals (max 64)");
+	}
+	condtags[nconds] = tags[i];
+	return nconds++;
+}
+
+static uvlong masks[MAXENTS]; // for each conditional entry, all bits required
+
+static void condmasks() {
+	for (int i = 0; i < nents; ++i) {
+		if (indents[i] == 0) continue;
+		uvlong mask = 1ull << condbit(i);
+		// nearest entry above with one less indent is the enclosing block
+		if (indents[i] > 1) {
+			int j = i - 1;
+			while (indents[j] != indents[i] - 1) --j;
+			mask |= masks[j];
+		}
+		masks[i] = mask;
+	}
+}
+
+static void foldcond(FILE *out, uvlong mask, bool yes,
+		const char *feattags) {
+	// a conditional is known to be true if it's implied by the tags of the
+	// feature using the entry (see gamedata.h), and known to be false if the
+	// tag doesn't exist on the current platform (i.e. is defined as 0). for a
+	// negated conditional it's the other way around.
+	const char *join = "";
+	for (int i = 0; i < nconds; ++i) {
+		if (!(mask & 1ull << i)) continue;
+		const char *tag = sbase + condtags[i];
+		bool neg = *tag == '!';
+		if (yes != neg) {
+			if_cold (fprintf(out, "%s_GAMEDATA_YES(%s, _gametype_tag_%s)",
+					join, feattags, tag + neg) < 0) {
+				diewrite();
+			}
+		}
+		else if_cold (fprintf(out, "%s_GAMEDATA_NO(_gametype_tag_%s)", join,
+				tag + neg) < 0) {
+			diewrite();
+		}
+		join = yes ? " && " : " || ";
+	}
+}
+
+static void foldexpr(FILE *out, int varidx, int idx) {
+	// work backwards from the last rule: if it definitely applies, that's the
+	// value; if it definitely doesn't, look at the one before; otherwise, we
+	// can't know until runtime. if no rules can apply, it's just the default.
+	int end = varidx + 1;
+	while (end < nents && indents[end] != 0) ++end;
+	for (int i = end - 1; i > varidx; --i) {
+		if (!exprs[i]) continue;
+		if_cold (fputs("\t", out) == EOF) diewrite();
+		foldcond(out, masks[i], true, "_gamedata_feattags");
+		if_cold (fprintf(out, " ? (%s) :\\\n\t!(", sbase + exprs[i]) < 0) {
+			diewrite();
+		}
+		foldcond(out, masks[i], false, "_gamedata_feattags");
+		if_cold (fprintf(out, ") ? _gamedata_vals[%d] :\\\n", idx) < 0) {
+			diewrite();
+		}
+	}
+	if (exprs[varidx]) {
+F( "	(%s) \\", sbase + exprs[varidx])
+	}
+	else {
+_( "	(-2147483647 - 1) \\")
+	}
+}
+
+// the same walk as above, but only says whether the value got worked out at
+// compile time, i.e. never reaches _gamedata_vals. engineapi.c uses this to
+// refuse runtime overrides which wouldn't be seen by every TU.
+static void foldedexpr(FILE *out, int varidx) {
+	int end = varidx + 1, nparens = 0;
+	while (end < nents && indents[end] != 0) ++end;
+	for (int i = end - 1; i > varidx; --i) {
+		if (!exprs[i]) continue;
+		if_cold (fputs("\t(", out) == EOF) diewrite();
+		foldcond(out, masks[i], true, "feattags");
+		if_cold (fputs(") || (", out) == EOF) diewrite();
+		foldcond(out, masks[i], false, "feattags");
+		if_cold (fputs(") && (\\\n", out) == EOF) diewrite();
+		++nparens;
+	}
+	if_cold (fputs("\t1", out) == EOF) diewrite();
+	for (int i = 0; i < nparens; ++i) {
+		if_cold (fputc(')', out) == EOF) diewrite();
+	}
+	if_cold (fputs(" \\\n", out) == EOF) diewrite();
+}
+
+static int nvars = 0; // number of entries needing to be set at runtime
+
 static inline void decls(FILE *out) {
 	for (int i = 0; i < nents; ++i) {
 		if (indents[i] != 0) continue;
@@ -215,60 +326,105 @@ F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
 		if_cold (i == nents - 1 || !indents[i + 1]) { // no tags - it's constant
 F( "enum { %s = (%s) };", sbase + tags[i], sbase + exprs[i])
 		}
-		else { // global variable intialised by initgamedata() call
-F( "extern int %s;", sbase + tags[i]);
+		else { // table entry intialised by initgamedata() call...
+			// ... unless it can be worked out at compile time in a given TU
+F( "#define %s ( \\", sbase + tags[i])
+			foldexpr(out, i, nvars++);
+_( ")")
+F( "#define _GAMEDATA_FOLDED_%s(feattags) ( \\", sbase + tags[i])
+			foldedexpr(out, i);
+_( ")")
 		}
 	}
+	if (nvars) {
+_( "extern int _gamedata_vals[];")
+	}
 }
 
 static inline void defs(FILE *out) {
+	if (!nvars) return;
+	// defaults are copied in by static initialisation; initgamedata() then
+	// only has to apply any game-specific rules that match
+_( "int _gamedata_vals[] = {")
 	for (int i = 0; i < nents; ++i) {
 		if (indents[i] != 0) continue;
 		if_hot (i < nents - 1 && indents[i + 1]) {
 F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
 			if (exprs[i]) {
-F( "int %s = (%s);", sbase + tags[i], sbase + exprs[i])
+F( "	(%s), // %s", sbase + exprs[i], sbase + tags[i])
 			}
 			else {
-F( "int %s = -2147483648;", sbase + tags[i])
+F( "	-2147483648, // %s", sbase + tags[i])
 			}
 		}
 	}
+_( "};")
+	// names are only used for runtime overrides, see engineapi.c
+_( "static const char *const _gamedata_names[] = {")
+	for (int i = 0; i < nents; ++i) {
+		if (indents[i] == 0 && i < nents - 1 && indents[i + 1]) {
+F( "	\"%s\",", sbase + tags[i])
+		}
+	}
+_( "};")
+	// ... and so that entries which are constant in some or all TUs can be
+	// rejected, since changing those would be ineffective or inconsistent
+_( "static bool _gamedata_folded(int idx, int feattags) {")
+_( "	switch (idx) {")
+	for (int i = 0, idx = 0; i < nents; ++i) {
+		if (indents[i] == 0 && i < nents - 1 && indents[i + 1]) {
+F( "		case %d: return _GAMEDATA_FOLDED_%s(feattags);", idx++,
+		sbase + tags[i])
+		}
+	}
+_( "	}")
+_( "	return false;")
+_( "}")
 }
 
 static inline void init(FILE *out) {
-_( "static void initgamedata() {")
-	int varidx;
-	int indent = 0;
-	for (int i = 0; i < nents; ++i) {
-		if (indents[i] < indents[i - 1]) {
-			for (; indent != indents[i]; --indent) {
-_i("}")
+	// rather than emitting nested if statements for everything, we evaluate
+	// all the conditionals once, and then go through a table of values in
+	// source order, each applying only if all its (nested) conditions matched.
+	// later matches overwrite earlier ones, just as the ifs would have done.
+	int nrules = 0;
+	for (int i = 0; i < nents; ++i) nrules += indents[i] && exprs[i];
+	const char *masktype = nconds > 32 ? "uvlong" : "u32";
+	if (nrules) {
+_( "static const struct {")
+F( "	%s mask;", masktype)
+_( "	int val;")
+_( "	ushort idx;")
+_( "} _gamedata_rules[] = {")
+		for (int i = 0, varidx = -1; i < nents; ++i) {
+			if (indents[i] == 0) {
+				if (i < nents - 1 && indents[i + 1]) ++varidx;
+				continue;
 			}
-		}
-		if (indents[i] == 0) {
-			varidx = i;
-			continue;
-		}
-F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
-		bool neg = sbase[tags[i]] == '!';
-		const char *excl = (const char *)"!" + !neg; // cast away warning
-		if (indents[i] > indents[i - 1]) {
-Fi("	if (%sGAMETYPE_MATCHES(%s)) {", excl, sbase + tags[i] + neg);
-			++indent;
-		}
-		else {
-_i("}")
+			if (!exprs[i]) continue;
 F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
-Fi("if (%sGAMETYPE_MATCHES(%s)) {", excl, sbase + tags[i] + neg);
-		}
-		if (exprs[i]) {
-F( "#line %d \"%" fS "\"", srclines[i], srcnames[srcfiles[i]])
-Fi("	%s = (%s);", sbase + tags[varidx], sbase + exprs[i])
+F( "	{0x%llX, (%s), %d},", masks[i], sbase + exprs[i], varidx)
 		}
+_( "};")
+_( "")
 	}
-	for (; indent != 0; --indent) {
-_i("}")
+_( "static void initgamedata() {")
+	if (nrules) {
+F( "	%s conds = 0;", masktype)
+		for (int i = 0; i < nconds; ++i) {
+			const char *tag = sbase + condtags[i];
+			bool neg = *tag == '!';
+			const char *excl = (const char *)"!" + !neg; // cast away warning
+F( "	conds |= (%s)%sGAMETYPE_MATCHES(%s) << %d;", masktype, excl,
+		tag + neg, i)
+		}
+_( "	for (int i = 0; i < countof(_gamedata_rules); ++i) {")
+F( "		%s mask = _gamedata_rules[i].mask;", masktype)
+_( "		if ((conds & mask) == mask) {")
+_( "			_gamedata_vals[_gamedata_rules[i].idx] =")
+_( "					_gamedata_rules[i].val;")
+_( "		}")
+_( "	}")
 	}
 _( "}")
 }
@@ -329,6 +485,7 @@ int OS_MAIN(int argc, os_char *argv[]) {
 	FILE *out = fopen(".build/include/gamedata.gen.h", "wb");
 	if_cold (!out) die(100, "couldn't open gamedata.gen.h");
 	H();
+	condmasks();
 	knowngames(out);
 	decls(out);
 
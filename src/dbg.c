@@ -26,7 +26,6 @@
 #include "intdefs.h"
 #include "ppmagic.h"
 #include "udis86.h"
-#include "vcall.h"
 
 #include <gamedatadbg.gen.h>
 #include <entpropsdbg.gen.h>
@@ -99,7 +98,6 @@ DEF_CCMD_HERE(sst_dbg_getcmdcb, "Get the address of a command callback", 0) {
 #endif
 }
 
-DECL_VFUNC_DYN(struct IServerGameDLL, struct ServerClass *, GetAllServerClasses)
 DEF_ARRAYIDX_ACCESSOR(struct SendProp, SendProp)
 DEF_ACCESSORS(struct SendProp, const char *, SP_varname)
 DEF_ACCESSORS(struct SendProp, int, SP_type)
@@ -131,7 +129,7 @@ DEF_CCMD_HERE(sst_dbg_sendtables, "Dump ServerClass/SendTable hierarchy", 0) {
 		errmsg_errorx("can't iterate ServerClass list: missing srvdll global");
 		return;
 	}
-	for (struct ServerClass *class = GetAllServerClasses(srvdll); class;
+	for (struct ServerClass *class = engineapi_serverclasses(); class;
 			class = class->next) {
 		struct SendTable *st = class->table;
 		con_msg("class %s (table %s)\n", class->name, st->tablename);
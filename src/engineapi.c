@@ -22,12 +22,16 @@
 #include "abi.h" // for NVDTOR use in gamedata generated code
 #include "con_.h"
 #include "engineapi.h"
+#include "errmsg.h"
 #include "gamedata.h"
 #include "gameinfo.h"
 #include "gametype.h"
 #include "intdefs.h"
 #include "langext.h"
+#include "loadprof.h"
 #include "mem.h" // "
+#include "os.h"
+#include "sst.h"
 #include "vcall.h"
 
 u32 _gametype_tag = 0; // declared in gametype.h but seems sensible enough here
@@ -48,10 +52,202 @@ struct CEngineVGui *vgui;
 struct CServerPlugin *pluginhandler;
 
 DECL_VFUNC_DYN(struct IServerGameDLL, struct ServerClass *, GetAllServerClasses)
+struct ServerClass *engineapi_serverclasses() {
+	return GetAllServerClasses(srvdll);
+}
 
 #include <entpropsinit.gen.h> // generated by build/mkentprops.c
 #include <gamedatainit.gen.h> // generated by build/mkgamedata.c
 
+// Gamedata overrides: an optional text file next to the plugin, which allows
+// vtable indices and such to be corrected by hand when a game update breaks
+// them, without having to wait for a new SST release. The format is the same
+// as the gamedata source files, minus conditionals - everything applies to the
+// current game - and values have to be plain integers, for instance:
+//
+//   vtidx_GetEngineBuildNumber 101 # comments work too
+//
+// Only entries which vary at runtime can be overridden; anything else has been
+// folded into the code at compile time. That includes entries whose rules only
+// apply on the other platform, and entries whose value is already known within
+// a GAMESPECIFIC() feature that runs on the current game, since that feature
+// would never see the change. Since has_* checks for entries just compare
+// against the missing value, setting an entry that the built-in gamedata lacks
+// for the current game also makes it available to features.
+#define OVERRIDEFILE "sst_gamedata.txt"
+
+static bool parseint(const char *s, int len, int *out) {
+	bool neg = len && *s == '-';
+	s += neg; len -= neg;
+	if_cold (!len) return false;
+	int base = 10;
+	if (len > 2 && s[0] == '0' && (s[1] | 32) == 'x') {
+		base = 16;
+		s += 2; len -= 2;
+	}
+	vlong ret = 0;
+	for (int i = 0; i < len; ++i) {
+		int digit;
+		if (s[i] >= '0' && s[i] <= '9') digit = s[i] - '0';
+		else if (base == 16 && (s[i] | 32) >= 'a' && (s[i] | 32) <= 'f') {
+			digit = (s[i] | 32) - 'a' + 10;
+		}
+		else {
+			return false;
+		}
+		ret = ret * base + digit;
+		// n.b. this also rules out INT_MIN, which means "missing" internally
+		if_cold (ret > 2147483647) return false;
+	}
+	*out = neg ? -ret : ret;
+	return true;
+}
+
+// tags of all GAMESPECIFIC() features, from glue.gen.h (see build/gluegen.c)
+extern const int _gamedata_feattaglist[], _gamedata_nfeattags;
+
+static bool isfolded(int idx) {
+	if (_gamedata_folded(idx, 0)) return true; // same in every TU
+	for (int i = 0; i < _gamedata_nfeattags; ++i) {
+		int tag = _gamedata_feattaglist[i];
+		// features for other games won't be loaded, so don't matter here
+		if ((_gametype_tag & tag) && _gamedata_folded(idx, tag)) return true;
+	}
+	return false;
+}
+
+static bool applyoverride(const char *k, int klen, const char *v, int vlen,
+		int line) {
+	int idx = -1;
+	for (int i = 0; i < countof(_gamedata_names); ++i) {
+		const char *name = _gamedata_names[i];
+		if (!strncmp(name, k, klen) && !name[klen]) {
+			idx = i;
+			break;
+		}
+	}
+	if_cold (idx == -1 || isfolded(idx)) {
+		errmsg_warnx(OVERRIDEFILE ":%d: unknown or non-overridable entry %.*s",
+				line, klen, k);
+		return false;
+	}
+	if_cold (!vlen) {
+		errmsg_warnx(OVERRIDEFILE ":%d: missing a value for %.*s", line,
+				klen, k);
+		return false;
+	}
+	int val;
+	if_cold (!parseint(v, vlen, &val)) {
+		errmsg_warnx(OVERRIDEFILE ":%d: invalid integer value %.*s", line,
+				vlen, v);
+		return false;
+	}
+	// a bogus vtable index or offset is a crash waiting to happen; at least
+	// rule out the obviously wrong ones
+	const char *name = _gamedata_names[idx];
+	if_cold (val < 0 && (!strncmp(name, "vtidx_", 6) ||
+			!strncmp(name, "off_", 4) || !strncmp(name, "sz_", 3))) {
+		errmsg_warnx(OVERRIDEFILE ":%d: %.*s can't be negative", line,
+				klen, k);
+		return false;
+	}
+	_gamedata_vals[idx] = val;
+	return true;
+}
+
+static void parseoverrides(const char *s, int len) {
+	// same state machine as build/mkgamedata.c, minus nesting
+	enum { BOL = 0, KEY = 4, KWS = 8, VAL = 12, COM = 16 };
+	static const s8 statetrans[] = {
+		// layout: any, space|tab, #, \n
+		[BOL + 0] = KEY, [BOL + 1] = BOL, [BOL + 2] = COM, [BOL + 3] = BOL,
+		[KEY + 0] = KEY, [KEY + 1] = KWS, [KEY + 2] = COM, [KEY + 3] = BOL,
+		[KWS + 0] = VAL, [KWS + 1] = KWS, [KWS + 2] = COM, [KWS + 3] = BOL,
+		[VAL + 0] = VAL, [VAL + 1] = VAL, [VAL + 2] = COM, [VAL + 3] = BOL,
+		[COM + 0] = COM, [COM + 1] = COM, [COM + 2] = COM, [COM + 3] = BOL
+	};
+	int key = 0, keyend = 0, val = 0, line = 1, nok = 0, nbad = 0;
+	bool indented = false;
+	// n.b. going one past the end treats a missing final EOL as if it's there
+	for (int state = BOL, i = 0; i <= len; ++i) {
+		int transidx = state;
+		char c = i == len ? '\n' : s[i];
+		switch (c) {
+			case ' ': case '\t': case '\r': transidx += 1; break;
+			case '#': transidx += 2; break;
+			case '\n': transidx += 3;
+		}
+		int newstate = statetrans[transidx];
+		if (state == BOL && newstate == BOL && c != '\n') indented = true;
+		if (newstate == KEY && state != KEY) key = i;
+		else if (newstate == KWS && state == KEY) keyend = i;
+		else if (newstate == VAL && state == KWS) val = i;
+		if ((newstate == BOL || newstate == COM) &&
+				state != BOL && state != COM) {
+			int end = i;
+			while (s[end - 1] == ' ' || s[end - 1] == '\t' ||
+					s[end - 1] == '\r') {
+				--end;
+			}
+			if (state == KEY) keyend = end;
+			if_cold (indented) {
+				errmsg_warnx(OVERRIDEFILE ":%d: unexpected indentation "
+						"(conditionals aren't supported here)", line);
+				++nbad;
+			}
+			else if (applyoverride(s + key, keyend - key, s + val,
+					state == VAL ? end - val : 0, line)) {
+				++nok;
+			}
+			else {
+				++nbad;
+			}
+		}
+		if (c == '\n') { ++line; indented = false; }
+		state = newstate;
+	}
+	if (nok) {
+		con_msg("sst: applied %d gamedata override%s from " OVERRIDEFILE "\n",
+				nok, nok == 1 ? "" : "s");
+	}
+	if_cold (nbad) {
+		errmsg_warnx("ignored %d invalid line%s in " OVERRIDEFILE, nbad,
+				nbad == 1 ? "" : "s");
+	}
+}
+
+static void loadoverrides() {
+	os_char path[PATH_MAX];
+	if_cold (os_dlfile(sst_ownhandle(), path, countof(path)) == -1) return;
+	int dirlen = os_strlen(path);
+	while (dirlen && path[dirlen - 1] != OS_LIT('/')
+#ifdef _WIN32
+			&& path[dirlen - 1] != L'\\'
+#endif
+			) {
+		--dirlen;
+	}
+	if_cold (dirlen + ssizeof(OVERRIDEFILE) > countof(path)) return;
+	os_spancopy(path + dirlen, OS_LIT(OVERRIDEFILE), ssizeof(OVERRIDEFILE));
+	int f = os_open_read(path);
+	if (f == -1) return; // almost always just means there's no file, i.e. fine
+	vlong len = os_fsize(f);
+	if_cold (len == -1) {
+		errmsg_warnsys("couldn't get size of " OVERRIDEFILE);
+		goto e;
+	}
+	if_cold (len > 1 << 20) {
+		errmsg_warnx(OVERRIDEFILE " is unreasonably large, ignoring it");
+		goto e;
+	}
+	if (len == 0) goto e; // can't map an empty file, and nothing to do anyway
+	const char *s = os_mapread(f, len);
+	if_cold (!s) { errmsg_warnsys("couldn't map " OVERRIDEFILE); goto e; }
+	parseoverrides(s, len);
+	os_unmap(s, len);
+e:	os_close(f);
+}
+
 bool engineapi_init(int pluginver) {
 	// set up all these interfaces first, so con_detect can use them (currently
 	// it just uses engclient for OE, and arguably that usage should also be
@@ -93,10 +289,21 @@ bool engineapi_init(int pluginver) {
 		_gametype_tag |= _gametype_tag_SrvDLL005;
 	}
 
-	if_cold (!con_detect(pluginver)) return false;
+	LOADPROF_BEGIN("con_detect");
+	bool ok = con_detect(pluginver);
+	LOADPROF_END();
+	if_cold (!ok) return false;
+	LOADPROF_BEGIN("initgamedata");
 	initgamedata();
+	loadoverrides();
+	LOADPROF_END();
+	LOADPROF_BEGIN("con_init");
 	con_init(); // rest of console setup requires having gamedata in place
-	if_cold (!gameinfo_init()) { con_disconnect(); return false; }
+	LOADPROF_END();
+	LOADPROF_BEGIN("gameinfo_init");
+	ok = gameinfo_init();
+	LOADPROF_END();
+	if_cold (!ok) { con_disconnect(); return false; }
 	return true;
 }
 
@@ -108,7 +315,9 @@ void engineapi_lateinit() {
 	if (srvdll && has_vtidx_GetAllServerClasses && has_sz_SendProp &&
 			has_off_SP_varname && has_off_SP_type && has_off_SP_offset &&
 			has_DPT_DataTable) {
-		initentprops(GetAllServerClasses(srvdll));
+		LOADPROF_BEGIN("initentprops");
+		initentprops(engineapi_serverclasses());
+		LOADPROF_END();
 	}
 }
 
@@ -127,6 +127,13 @@ extern struct CGlobalVars *globalvars;
 extern struct IInputSystem *inputsystem;
 extern struct CEngineVGui *vgui;
 
+/*
+ * Returns the head of the server's linked list of ServerClasses. The caller
+ * must first make sure that srvdll is non-null and that the
+ * vtidx_GetAllServerClasses gamedata entry is present.
+ */
+struct ServerClass *engineapi_serverclasses();
+
 // XXX: not exactly engine *API* but not currently clear where else to put this
 struct CPlugin_common_v2v3 {
 	bool paused;
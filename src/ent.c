@@ -14,6 +14,8 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
+
 #include "accessor.h"
 #include "chunklets/x86.h"
 #include "con_.h"
@@ -25,6 +27,7 @@
 #include "intdefs.h"
 #include "langext.h"
 #include "mem.h"
+#include "sst.h"
 #include "vcall.h"
 #include "x86util.h"
 
@@ -32,10 +35,22 @@ FEATURE()
 
 DECL_VFUNC_DYN(struct VEngineServer, struct edict *, PEntityOfEntIndex, int)
 
+DECL_VFUNC_DYN(struct IServerNetworkable, struct ServerClass *, GetServerClass)
+DECL_VFUNC_DYN(struct IServerNetworkable, const char *, GetClassName)
+
 DEF_PTR_ACCESSOR(struct CGlobalVars, struct edict *, edicts)
 DEF_ARRAYIDX_ACCESSOR(struct edict, edict)
+DEF_ARRAYIDX_ACCESSOR(struct SendProp, SendProp)
+DEF_ACCESSORS(struct SendProp, const char *, SP_varname)
+DEF_ACCESSORS(struct SendProp, int, SP_type)
+DEF_ACCESSORS(struct SendProp, int, SP_offset)
+DEF_ACCESSORS(struct SendProp, struct SendTable *, SP_subtable)
 
 static struct edict **edicts = 0;
+// ent_getedict() only uses the above as a fallback, but iteration goes straight
+// through the edict array whenever it's available, since it does its own bounds
+// and free-slot checks.
+static struct edict **iteredicts = 0;
 
 struct edict *ent_getedict(int idx) {
 	if (edicts) {
@@ -54,6 +69,175 @@ void *ent_get(int idx) {
 	return 0;
 }
 
+// path lookups are cached by FNV-1a hash, with the paths themselves copied into
+// a fixed buffer so callers don't have to keep their strings around. once
+// either of these fills up we just stop caching, which is fine since nothing
+// should be asking for anywhere near that many different props.
+#define PROPCACHE_SZ 512 // power of 2!
+static struct propcacheent {
+	const char *path; // null for unused slots
+	u32 hash;
+	int off;
+} propcache[PROPCACHE_SZ];
+static int npropcache = 0;
+static char proppaths[8192];
+static int proppathslen = 0;
+
+static inline u32 strhash(const char *s, int *len) {
+	u32 h = 0x811C9DC5;
+	const char *p = s;
+	for (; *p; ++p) h = (h ^ (uchar)*p) * 0x01000193;
+	*len = p - s;
+	return h;
+}
+
+static inline bool compeq(const char *name, const char *comp, int len) {
+	return !strncmp(name, comp, len) && name[len] == '\0';
+}
+
+static int resolveprop(const char *path) {
+	const char *comp = path, *end = comp + strcspn(comp, "/");
+	if (!*end) return -1; // need at least a class and a prop
+	const struct ServerClass *class = engineapi_serverclasses();
+	for (; class; class = class->next) {
+		if (compeq(class->name, comp, end - comp)) break;
+	}
+	if (!class) return -1;
+	const struct SendTable *st = class->table;
+	int off = 0;
+	for (;;) {
+		comp = end + 1;
+		end = comp + strcspn(comp, "/");
+		const struct SendProp *p = 0;
+		for (int i = 0; i < st->nprops; ++i) {
+			const struct SendProp *q = arrayidx_SendProp(st->props, i);
+			if (compeq(get_SP_varname(q), comp, end - comp)) { p = q; break; }
+		}
+		if (!p) return -1;
+		off += get_SP_offset(p);
+		if (!*end) return off;
+		if (get_SP_type(p) != DPT_DataTable) return -1;
+		if (!(st = get_SP_subtable(p))) return -1;
+	}
+}
+
+int ent_propoffset(const char *path) {
+	if_cold (!srvdll || !has_vtidx_GetAllServerClasses || !has_sz_SendProp ||
+			!has_off_SP_varname || !has_off_SP_type || !has_off_SP_offset ||
+			!has_off_SP_subtable || !has_DPT_DataTable) {
+		return -1;
+	}
+	int len;
+	u32 h = strhash(path, &len);
+	uint i = h;
+	for (;; ++i) {
+		i &= PROPCACHE_SZ - 1;
+		const struct propcacheent *e = propcache + i;
+		if (!e->path) break;
+		if_hot (e->hash == h && !strcmp(e->path, path)) return e->off;
+	}
+	int off = resolveprop(path);
+	// don't remember misses: the class may just not be there yet (e.g. before
+	// the server has loaded), and a later lookup should get another chance
+	if (off == -1) return -1;
+	// leave some slack in the table to keep probe sequences short
+	if (npropcache < PROPCACHE_SZ * 3 / 4 &&
+			proppathslen + len + 1 <= sizeof(proppaths)) {
+		char *copy = proppaths + proppathslen;
+		memcpy(copy, path, len + 1);
+		proppathslen += len + 1;
+		propcache[i] = (struct propcacheent){copy, h, off};
+		++npropcache;
+	}
+	return off;
+}
+
+// the engine always allocates this many, regardless of how many are in use
+#define MAX_EDICTS 2048
+#define FL_EDICT_FREE 2
+
+u32 ent_namehash(const char *classname) {
+	int len;
+	return strhash(classname, &len);
+}
+
+static inline bool canfilter(const struct ent_iter *it) {
+	if (it->_class && !has_vtidx_GetServerClass) return false;
+	if (it->_namehash && !has_vtidx_GetClassName) return false;
+	return true;
+}
+
+static bool nextuncached(struct ent_iter *it) {
+	struct edict *base = 0;
+	if (iteredicts && !(base = *iteredicts)) goto e; // not connected
+	for (int i = it->idx + 1; i < MAX_EDICTS; ++i) {
+		struct edict *e = base ? arrayidx_edict(base, i) :
+				PEntityOfEntIndex(engserver, i);
+		if (!e || e->stateflags & FL_EDICT_FREE || !e->ent_networkable) {
+			continue;
+		}
+		struct IServerNetworkable *net = e->ent_networkable;
+		if (it->_class && GetServerClass(net) != it->_class) continue;
+		if (it->_namehash && ent_namehash(GetClassName(net)) != it->_namehash) {
+			continue;
+		}
+		it->idx = i;
+		it->edict = e;
+		return true;
+	}
+e:	it->idx = MAX_EDICTS;
+	it->edict = 0;
+	return false;
+}
+
+// snapshot of all the live edicts, taken the first time a cached iterator is
+// used in a given tick. the class and name are looked up once here, so
+// filtering afterwards is just a compare.
+static struct tickent {
+	struct edict *edict;
+	const struct ServerClass *class;
+	u32 namehash;
+	int idx;
+} tickents[MAX_EDICTS];
+static int ntickents = -1; // -1 means out of date
+
+static void snapshot() {
+	ntickents = 0;
+	bool hasclass = has_vtidx_GetServerClass, hasname = has_vtidx_GetClassName;
+	for (struct ent_iter it = ent_iter_all(0); nextuncached(&it);) {
+		struct IServerNetworkable *net = it.edict->ent_networkable;
+		tickents[ntickents++] = (struct tickent){
+			.edict = it.edict,
+			.class = hasclass ? GetServerClass(net) : 0,
+			.namehash = hasname ? ent_namehash(GetClassName(net)) : 0,
+			.idx = it.idx
+		};
+	}
+}
+
+bool ent_next(struct ent_iter *it) {
+	if_cold (!canfilter(it)) return false;
+	if (!(it->_flags & ENT_ITER_CACHED)) return nextuncached(it);
+	if (ntickents == -1) snapshot();
+	for (int i = it->_pos + 1; i < ntickents; ++i) {
+		const struct tickent *e = tickents + i;
+		if (it->_class && e->class != it->_class) continue;
+		if (it->_namehash && e->namehash != it->_namehash) continue;
+		it->_pos = i;
+		it->idx = e->idx;
+		it->edict = e->edict;
+		return true;
+	}
+	it->_pos = ntickents;
+	it->idx = MAX_EDICTS;
+	it->edict = 0;
+	return false;
+}
+
+HANDLE_EVENT(Tick, bool simulating) {
+	ntickents = -1;
+}
+
 struct CEntityFactory {
 	struct CEntityFactory_vtable {
 		void /*IServerNetworkable*/ *(*VCALLCONV Create)(
@@ -81,13 +265,17 @@ static inline bool find_entfactorydict(const uchar *insns) {
 			entfactorydict = mem_loadptr(p + 7);
 			return true;
 		}
-		NEXT_INSN(p, "entity factory dictionary");
+		NEXT_INSN_QUIET(p);
 	}
 	return false;
 }
+
+// N.B. the command lookup is done in PRESCAN on the main thread, while the
+// actual search is done in SCAN, possibly on another thread
+static const uchar *dumpentityfactories_insns = 0;
 #endif
 
-const struct CEntityFactory *ent_getfactory(const char *name) {
+static const struct CEntityFactory *findfactory(const char *name) {
 #ifdef _WIN32
 	if (entfactorydict) {
 		return CUtlDict_p_ushort_findval(&entfactorydict->dict, name);
@@ -143,7 +331,7 @@ static inline ctor_func findctor(const struct CEntityFactory *factory,
 	return 0;
 }
 
-void **ent_findvtable(const struct CEntityFactory *factory,
+static void **findvtable(const struct CEntityFactory *factory,
 		const char *classname) {
 #ifdef _WIN32
 	ctor_func ctor = findctor(factory, classname);
@@ -167,23 +355,131 @@ void **ent_findvtable(const struct CEntityFactory *factory,
 	return 0;
 }
 
-INIT {
+// factory and vtable lookups are memoised, since the former is a tree search
+// full of string compares and the latter has to disassemble a bunch of code.
+// as with the prop cache above, names are copied into a fixed buffer and we
+// stop caching if things fill up. failures aren't cached, and both caches are
+// wiped on level shutdown and on unload, since the vtable cache is keyed by
+// factory pointer and those could get reused if server.dll is reloaded.
+#define FACTORYCACHE_SZ 256 // power of 2!
+static struct factorycacheent {
+	const char *name; // null for unused slots
+	u32 hash;
+	const struct CEntityFactory *factory;
+} factorycache[FACTORYCACHE_SZ];
+static int nfactorycache = 0;
+static char factorynames[4096];
+static int factorynameslen = 0;
+
+#define VTCACHE_SZ 256 // power of 2!
+static struct vtcacheent {
+	const struct CEntityFactory *factory; // null for unused slots
+	void **vtable;
+} vtcache[VTCACHE_SZ];
+static int nvtcache = 0;
+
+const struct CEntityFactory *ent_getfactory(const char *name) {
+	int len;
+	u32 h = strhash(name, &len);
+	uint i = h;
+	for (;; ++i) {
+		i &= FACTORYCACHE_SZ - 1;
+		const struct factorycacheent *e = factorycache + i;
+		if (!e->name) break;
+		if_hot (e->hash == h && !strcmp(e->name, name)) return e->factory;
+	}
+	const struct CEntityFactory *factory = findfactory(name);
+	if (factory && nfactorycache < FACTORYCACHE_SZ * 3 / 4 &&
+			factorynameslen + len + 1 <= sizeof(factorynames)) {
+		char *copy = factorynames + factorynameslen;
+		memcpy(copy, name, len + 1);
+		factorynameslen += len + 1;
+		factorycache[i] = (struct factorycacheent){copy, h, factory};
+		++nfactorycache;
+	}
+	return factory;
+}
+
+void **ent_findvtable(const struct CEntityFactory *factory,
+		const char *classname) {
+	uint i = ((usize)factory >> 2) * 2654435761u;
+	for (;; ++i) {
+		i &= VTCACHE_SZ - 1;
+		const struct vtcacheent *e = vtcache + i;
+		if (!e->factory) break;
+		if_hot (e->factory == factory) return e->vtable;
+	}
+	void **vtable = findvtable(factory, classname);
+	if (vtable && nvtcache < VTCACHE_SZ * 3 / 4) {
+		vtcache[i] = (struct vtcacheent){factory, vtable};
+		++nvtcache;
+	}
+	return vtable;
+}
+
+int ent_findvtables(struct ent_vtablequery *queries, int n) {
+	int nfound = 0;
+	for (int i = 0; i < n; ++i) {
+		struct ent_vtablequery *q = queries + i;
+		q->factory = ent_getfactory(q->name);
+		q->vtable = q->factory ? ent_findvtable(q->factory, q->classname) : 0;
+		nfound += !!q->vtable;
+	}
+	return nfound;
+}
+
+static void wipecaches() {
+	memset(factorycache, 0, sizeof(factorycache));
+	nfactorycache = 0;
+	factorynameslen = 0;
+	memset(vtcache, 0, sizeof(vtcache));
+	nvtcache = 0;
+}
+
+HANDLE_EVENT(LevelShutdown) {
+	ntickents = -1;
+	wipecaches();
+}
+
+PRESCAN {
 #ifdef _WIN32 // TODO(linux): above
 	struct con_cmd *dumpentityfactories = con_findcmd("dumpentityfactories");
-	if_cold (!dumpentityfactories ||
-			!find_entfactorydict(dumpentityfactories->cb_insns)) {
+	if_cold (!dumpentityfactories) return false;
+	dumpentityfactories_insns = dumpentityfactories->cb_insns;
+	return true;
+#else
+	return false;
+#endif
+}
+
+SCAN {
+#ifdef _WIN32 // TODO(linux): above
+	find_entfactorydict(dumpentityfactories_insns);
+#endif
+}
+
+INIT {
+#ifdef _WIN32 // TODO(linux): above
+	if_cold (!entfactorydict) {
 		errmsg_warnx("server entity factories unavailable");
 	}
 #endif
 
+	// when iterating, prefer direct access to the edict array where possible,
+	// since it saves a vcall per entity, which adds up over all of them.
+	if (globalvars && has_off_edicts) iteredicts = getptr_edicts(globalvars);
 	// for PEntityOfEntIndex we don't really have to do any more init, we
 	// can just call the function later.
 	if (has_vtidx_PEntityOfEntIndex) return FEAT_OK;
-	if (globalvars && has_off_edicts) {
-		edicts = getptr_edicts(globalvars);
+	if (iteredicts) {
+		edicts = iteredicts;
 		return FEAT_OK;
 	}
 	return FEAT_INCOMPAT;
 }
 
+END {
+	wipecaches();
+}
+
 // vi: sw=4 ts=4 noet tw=80 cc=80
@@ -18,6 +18,7 @@
 #define INC_ENT_H
 
 #include "engineapi.h"
+#include "intdefs.h"
 #include "vcall.h"
 
 /* Returns a server-side edict pointer, or null if not found. */
@@ -26,6 +27,77 @@ struct edict *ent_getedict(int idx);
 /* Returns an opaque pointer to a server-side entity, or null if not found. */
 void *ent_get(int idx);
 
+/*
+ * Returns the hash of an entity classname (e.g. "prop_physics") for use with
+ * ent_iter_byname(). Callers iterating repeatedly may want to compute this once
+ * up-front and keep it around.
+ */
+u32 ent_namehash(const char *classname);
+
+/*
+ * An iterator over server-side edicts, skipping free slots. Use it like so:
+ *
+ *   for (struct ent_iter it = ent_iter_all(0); ent_next(&it);) {
+ *       // do something with it.edict and/or it.idx
+ *   }
+ *
+ * If ENT_ITER_CACHED is passed as a flag, the iterator walks a snapshot of the
+ * edict list taken on the first cached iteration of the current tick, making
+ * repeated queries within a tick (e.g. from multiple features) basically free.
+ * The tradeoff is that entities created or freed later in the same tick won't
+ * be accounted for. Without the flag, the edict array is walked directly.
+ */
+struct ent_iter {
+	int idx; // index of the current edict
+	struct edict *edict; // the current edict; always non-null in the loop body
+	// private:
+	int _flags, _pos;
+	const struct ServerClass *_class;
+	u32 _namehash;
+};
+
+enum { ENT_ITER_CACHED = 1 };
+
+/* Begins iterating over all edicts. */
+static inline struct ent_iter ent_iter_all(int flags) {
+	return (struct ent_iter){.idx = -1, ._flags = flags, ._pos = -1};
+}
+
+/*
+ * Begins iterating over edicts whose classname has the given hash, as returned
+ * by ent_namehash().
+ */
+static inline struct ent_iter ent_iter_byname(u32 namehash, int flags) {
+	return (struct ent_iter){
+		.idx = -1, ._flags = flags, ._pos = -1, ._namehash = namehash
+	};
+}
+
+/* Begins iterating over edicts whose entities have the given ServerClass. */
+static inline struct ent_iter ent_iter_byclass(const struct ServerClass *class,
+		int flags) {
+	return (struct ent_iter){
+		.idx = -1, ._flags = flags, ._pos = -1, ._class = class
+	};
+}
+
+/*
+ * Advances an iterator to the next matching edict, returning false once there
+ * are none left. Main thread only.
+ */
+bool ent_next(struct ent_iter *it);
+
+/*
+ * Returns the offset of a server-side entity property given a path in the same
+ * format as gamedata/entprops.txt (e.g. "CBaseEntity/m_Collision/m_vecMins"),
+ * or -1 if the property doesn't exist or SendTables are unavailable.
+ *
+ * Unlike entprops.txt, this works for any property without a rebuild, and only
+ * walks the SendTables on the first lookup of each path; later lookups are
+ * served from a cache. Should only be called from the main thread.
+ */
+int ent_propoffset(const char *path);
+
 struct CEntityFactory; // opaque for now, can move out of ent.c if needed later
 
 /*
@@ -48,6 +120,28 @@ const struct CEntityFactory *ent_getfactory(const char *name);
 void **ent_findvtable(const struct CEntityFactory *factory,
 		const char *classname);
 
+/*
+ * Describes a lookup to be performed by ent_findvtables(). name and classname
+ * are the same as the respective parameters of ent_getfactory() and
+ * ent_findvtable(). The factory and vtable are filled in by the lookup, and
+ * either or both may end up null.
+ */
+struct ent_vtablequery {
+	const char *name, *classname;
+	const struct CEntityFactory *factory;
+	void **vtable;
+};
+
+/*
+ * Looks up the factories and vtables of a whole array of entity classes in one
+ * go, returning the number of vtables that were found.
+ *
+ * Both this and the above functions cache their results until the next level
+ * shutdown, so it's fine to call them repeatedly, e.g. from a command handler.
+ * Main thread only.
+ */
+int ent_findvtables(struct ent_vtablequery *queries, int n);
+
 #endif
 
 // vi: sw=4 ts=4 noet tw=80 cc=80
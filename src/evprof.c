@@ -0,0 +1,51 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "con_.h"
+#include "engineapi.h"
+#include "evprof.h"
+#include "intdefs.h"
+
+// N.B. this file is only built with evprof=1, which also defines SST_EVPROF
+
+DEF_CCMD_HERE(sst_evprof, "Print event handler timing statistics", 0) {
+	struct rgba white = {255, 255, 255, 255};
+	for (int i = 0; i < evprof_nevents; ++i) {
+		const struct evprof_event *e = evprof_events + i;
+		uvlong total = 0;
+		for (int j = 0; j < e->nhandlers; ++j) total += e->handlers[j].cycles;
+		con_colourmsg(&white, "%s: %llu cycles\n", e->name, total);
+		for (int j = 0; j < e->nhandlers; ++j) {
+			const struct evprof_handler *h = e->handlers + j;
+			con_msg("  %-20s %10llu calls %14llu cycles %10llu avg %5.1f%%\n",
+					h->modname, h->calls, h->cycles,
+					h->calls ? h->cycles / h->calls : 0,
+					total ? h->cycles * 100.0 / total : 0.0);
+		}
+	}
+}
+
+DEF_CCMD_HERE(sst_evprof_reset, "Reset event handler timing statistics", 0) {
+	for (int i = 0; i < evprof_nevents; ++i) {
+		const struct evprof_event *e = evprof_events + i;
+		for (int j = 0; j < e->nhandlers; ++j) {
+			e->handlers[j].calls = 0;
+			e->handlers[j].cycles = 0;
+		}
+	}
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
@@ -0,0 +1,71 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INC_EVPROF_H
+#define INC_EVPROF_H
+
+#include "intdefs.h"
+
+/*
+ * Optional event handler profiling, used by generated EMIT_/CHECK_ functions.
+ * Built in only if SST_EVPROF is defined (evprof=1 in the compile scripts),
+ * in which case each handler call is timed in CPU cycles and counted, and the
+ * totals can be viewed with the sst_evprof command. Otherwise, all of this
+ * compiles down to nothing and handlers are called directly.
+ */
+
+struct evprof_handler {
+	const char *modname;
+	uvlong calls, cycles;
+	uvlong _start;
+};
+
+struct evprof_event {
+	const char *name;
+	struct evprof_handler *handlers;
+	int nhandlers;
+};
+
+#ifdef SST_EVPROF
+
+/* These are defined in generated code. Only events with handlers are listed. */
+extern const struct evprof_event evprof_events[];
+extern const int evprof_nevents;
+
+static inline void _evprof_begin(struct evprof_handler *h) {
+	h->_start = __builtin_readcyclecounter();
+}
+
+static inline bool _evprof_end(struct evprof_handler *h, bool ret) {
+	h->cycles += __builtin_readcyclecounter() - h->_start;
+	++h->calls;
+	return ret;
+}
+
+#define EVPROF_CALL(h, call) \
+	((void)(_evprof_begin(h), (call), _evprof_end((h), false)))
+#define EVPROF_CHECK(h, call) (_evprof_begin(h), _evprof_end((h), (call)))
+
+#else
+
+#define EVPROF_CALL(h, call) (call)
+#define EVPROF_CHECK(h, call) (call)
+
+#endif
+
+#endif
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
@@ -17,13 +17,18 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <math.h>
 #include <stdlib.h>
 
+#include "accessor.h"
 #include "chunklets/x86.h"
+#include "con_.h"
 #include "engineapi.h"
 #include "errmsg.h"
+#include "event.h"
 #include "gamedata.h"
 #include "gametype.h"
+#include "fastfwd.h"
 #include "feature.h"
 #include "hook.h"
 #include "intdefs.h"
@@ -37,6 +42,7 @@ FEATURE()
 // tas_pause hook. so, disable for non-L4D games for now, to be polite.
 // TODO(compat): come up with a real solution for this if/when required
 GAMESPECIFIC(L4Dbased)
+REQUIRE_GLOBAL(globalvars)
 REQUIRE_GAMEDATA(vtidx_RunFrame)
 REQUIRE_GAMEDATA(vtidx_Frame)
 REQUIRE_GAMEDATA(vtidx_GetRealTime)
@@ -46,27 +52,120 @@ typedef void (*Host_AccumulateTime_func)(float dt);
 static Host_AccumulateTime_func orig_Host_AccumulateTime;
 static float *realtime, *host_frametime;
 
+DEF_ACCESSORS(struct CGlobalVars, float, tickinterval)
+
+DEF_FEAT_CVAR_MINMAX(sst_fastfwd_budget,
+		"Real time to spend on each frame in adaptive fast-forwarding (ms)",
+		33, 5, 200, CON_ARCHIVE)
+DEF_FEAT_CVAR_MINMAX(sst_fastfwd_minrate,
+		"Minimum timescale for adaptive fast-forwarding", 5, 1, 1000,
+		CON_ARCHIVE)
+DEF_FEAT_CVAR_MINMAX(sst_fastfwd_maxrate,
+		"Maximum timescale for adaptive fast-forwarding", 100, 1, 1000,
+		CON_ARCHIVE)
+
+// queued segments, as a ring. the one at the head is the one in progress
+#define MAXSEGS 64 // power of 2!
+static struct seg { float secs, rate; void (*cb)(); } segs[MAXSEGS];
+static uint seghead = 0, segtail = 0;
+
+// state of the current segment: faster ones are handled by skipping time in
+// hook_Host_AccumulateTime(), normal-speed ones by counting down ticks
 static float skiptime = 0.0, skiprate;
+static int waitticks = 0;
+
+// for adaptive segments: estimated real seconds spent per game second skipped,
+// and the amount skipped last frame. the dt passed to Host_AccumulateTime is
+// the real time the previous frame took, so that's all we need to measure. the
+// estimate is kept between segments so each one starts off about right.
+static float costpersec = 0, lastskip = 0;
+
+static float adaptiveskip(float dt) {
+	if (lastskip) {
+		float sample = dt / lastskip;
+		if (costpersec) costpersec += (sample - costpersec) * 0.25f;
+		else costpersec = sample;
+	}
+	float lo = con_getvarf(sst_fastfwd_minrate) * dt;
+	float hi = con_getvarf(sst_fastfwd_maxrate) * dt;
+	if (!costpersec) return lo; // nothing to go on yet, so be conservative
+	float ret = con_getvarf(sst_fastfwd_budget) * 0.001f / costpersec;
+	if (ret < lo) ret = lo; else if (ret > hi) ret = hi;
+	return ret;
+}
+
+// sets up the state for the head segment; returns false if it's empty
+static bool startseg() {
+	const struct seg *s = segs + (seghead & MAXSEGS - 1);
+	float interval = get_tickinterval(globalvars);
+	int ticks = roundf(s->secs / interval);
+	if (ticks <= 0) return false;
+	if (s->rate == 1) {
+		waitticks = ticks;
+	}
+	else {
+		skiptime = ticks * interval;
+		skiprate = s->rate;
+	}
+	return true;
+}
+
+// finishes the head segment and moves on to the next non-empty one, if any
+static void advance() {
+	skiptime = 0; waitticks = 0;
+	do {
+		void (*cb)() = segs[seghead++ & MAXSEGS - 1].cb;
+		if (cb) cb();
+	} while (seghead != segtail && !startseg());
+}
+
 static void hook_Host_AccumulateTime(float dt) {
-	float skipinc = skiprate * dt;
 	if_hot (!skiptime) {
+		lastskip = 0;
 		orig_Host_AccumulateTime(dt);
 		return;
 	}
+	float skipinc = skiprate == FASTFWD_ADAPTIVE ? adaptiveskip(dt) :
+			skiprate * dt;
 	if_random (skiptime <= skipinc) skipinc = skiptime; // should become fcmovbe
 	skiptime -= skipinc;
+	lastskip = skipinc;
 	*realtime += skipinc;
 	*host_frametime = skipinc;
+	if_random (!skiptime) advance();
+}
+
+HANDLE_EVENT(Tick, bool simulating) {
+	if (simulating && waitticks && !--waitticks) advance();
+}
+
+bool fastfwd_queue(float seconds, float timescale, void (*cb)()) {
+	if_cold (segtail - seghead == MAXSEGS) return false;
+	segs[segtail++ & MAXSEGS - 1] = (struct seg){seconds, timescale, cb};
+	if (segtail - seghead == 1 && !startseg()) advance();
+	return true;
+}
+
+void fastfwd_cancel() {
+	seghead = segtail;
+	skiptime = 0; waitticks = 0;
 }
 
 void fastfwd(float seconds, float timescale) {
-	skiptime = seconds;
-	skiprate = timescale;
+	fastfwd_cancel();
+	fastfwd_queue(seconds, timescale, 0);
 }
 
-void fastfwd_add(float seconds, float timescale) {
-	skiptime += seconds;
-	skiprate = timescale;
+bool fastfwd_finish(float timescale) {
+	if (seghead == segtail) return false;
+	float total = skiptime + waitticks * get_tickinterval(globalvars);
+	for (uint i = seghead + 1; i != segtail; ++i) {
+		if (segs[i & MAXSEGS - 1].secs > 0) total += segs[i & MAXSEGS - 1].secs;
+	}
+	void (*cb)() = segs[(segtail - 1) & MAXSEGS - 1].cb;
+	fastfwd_cancel();
+	fastfwd_queue(total, timescale, cb);
+	return true;
 }
 
 static inline void *find_eng(void *runframe) {
@@ -80,7 +179,7 @@ static inline void *find_eng(void *runframe) {
 			void **indirect = mem_loadptr(p + 2);
 			return *indirect;
 		}
-		NEXT_INSN(p, "eng global object");
+		NEXT_INSN_QUIET(p);
 	}
 #else
 #warning TODO(linux): yet another assembly thing
@@ -96,16 +195,16 @@ static inline void *find_HostState_Frame(void *Frame) {
 	for (const uchar *p = insns; p - insns < 640;) {
 		if (p[0] == X86_ALUMI8S && (p[1] & 0x38) == X86_MODRM(0, 7, 0) &&
 				p[2] == 2) {
-			NEXT_INSN(p, "HostState_Frame");
+			NEXT_INSN_QUIET(p);
 			while (p - insns < 640) {
 				if (p[0] == X86_CALL) {
 					return (uchar *)p + 5 + mem_loads32(p + 1);
 				}
-				NEXT_INSN(p, "HostState_Frame");
+				NEXT_INSN_QUIET(p);
 			}
 			return 0;
 		}
-		NEXT_INSN(p, "HostState_Frame");
+		NEXT_INSN_QUIET(p);
 	}
 #else
 #warning TODO(linux): yet another assembly thing
@@ -119,7 +218,7 @@ static inline void *find_FrameUpdate(void *HostState_Frame) {
 	const uchar *insns = (const uchar *)HostState_Frame;
 	for (const uchar *p = insns; p - insns < 384;) {
 		if (p[0] == X86_CALL) return (uchar *)p + 5 + mem_loads32(p + 1);
-		NEXT_INSN(p, "CHostState::FrameUpdate");
+		NEXT_INSN_QUIET(p);
 	}
 #else
 #warning TODO(linux): yet another assembly thing
@@ -132,18 +231,18 @@ static inline bool find_Host_AccumulateTime(void *_Host_RunFrame) {
 	const uchar *insns = (const uchar *)_Host_RunFrame;
 	for (const uchar *p = insns; p - insns < 384;) {
 		if (p[0] == X86_FLTBLK2 && p[1] == X86_MODRM(1, 0, 5) && p[2] == 8) {
-			NEXT_INSN(p, "Host_AccumulateTime");
+			NEXT_INSN_QUIET(p);
 			while (p - insns < 384) {
 				if (p[0] == X86_CALL) {
 					orig_Host_AccumulateTime = (Host_AccumulateTime_func)(
 							p + 5 + mem_loads32(p + 1));
 					return true;
 				}
-				NEXT_INSN(p, "Host_AccumulateTime");
+				NEXT_INSN_QUIET(p);
 			}
 			return false;
 		}
-		NEXT_INSN(p, "Host_AccumulateTime");
+		NEXT_INSN_QUIET(p);
 	}
 	return false;
 #else
@@ -163,77 +262,87 @@ static inline float *find_float(void *func) {
 // a few layers of the call stack have the target function take a float arg,
 // so we can look for a particular number of FLD instructions followed by a CALL
 // and then grab the function from that
-static void *find_floatcall(void *func, int fldcnt, const char *name) {
+static void *find_floatcall(void *func, int fldcnt) {
 	// TODO(linux): likewise this has a chance of working, but needs testing
 	const uchar *insns = (const uchar *)func;
 	for (const uchar *p = insns; p - insns < 384;) {
 		if (p[0] == X86_FLTBLK2 && (p[1] & 0x38) == 0) {
-			NEXT_INSN(p, name);
+			NEXT_INSN_QUIET(p);
 			while (p - insns < 384) {
 				if (p[0] == X86_CALL) {
 					if (!--fldcnt) return (uchar *)p + 5 + mem_loads32(p + 1);
 					goto next;
 				}
-				NEXT_INSN(p, name);
+				NEXT_INSN_QUIET(p);
 			}
 			return 0;
 		}
-next:	NEXT_INSN(p, name);
+next:	NEXT_INSN_QUIET(p);
 	}
 	return 0;
 }
 
-INIT {
+// N.B. all the finding is done in SCAN, possibly on another thread, which
+// can't print anything, so errors are stashed here for INIT to report
+static const char *scanerr = 0;
+
+SCAN {
 	void *hldsapi = factory_engine("VENGINE_HLDS_API_VERSION002", 0);
 	if_cold (!hldsapi) {
-		errmsg_errorx("couldn't find HLDS API interface");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find HLDS API interface";
+		return;
 	}
 	void *enginetool = factory_engine("VENGINETOOL003", 0);
 	if_cold (!enginetool) {
-		errmsg_errorx("missing engine tool interface");
-		return FEAT_INCOMPAT;
+		scanerr = "missing engine tool interface";
+		return;
 	}
 	// behold: the greatest pointer chase of all time
 	realtime = find_float((*(void ***)enginetool)[vtidx_GetRealTime]);
 	if_cold (!realtime) {
-		errmsg_errorx("couldn't find realtime variable");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find realtime variable";
+		return;
 	}
 	host_frametime = find_float((*(void ***)enginetool)[vtidx_HostFrameTime]);
 	if_cold (!host_frametime) {
-		errmsg_errorx("couldn't find host_frametime variable");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find host_frametime variable";
+		return;
 	}
 	void *eng = find_eng((*(void ***)hldsapi)[vtidx_RunFrame]);
 	if_cold (!eng) {
-		errmsg_errorx("couldn't find eng global object");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find eng global object";
+		return;
 	}
 	void *func;
 	if_cold (!(func = find_HostState_Frame((*(void ***)eng)[vtidx_Frame]))) {
-		errmsg_errorx("couldn't find HostState_Frame function");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find HostState_Frame function";
+		return;
 	}
 	if_cold (!(func = find_FrameUpdate(func))) {
-		errmsg_errorx("couldn't find FrameUpdate function");
-		return FEAT_INCOMPAT;
+		scanerr = "couldn't find FrameUpdate function";
+		return;
 	}
 	if_cold (!(func = find_floatcall(func, GAMETYPE_MATCHES(L4D2_2125plus) ?
-			2 : 1, "CHostState::State_Run"))) {
-		errmsg_errorx("couldn't find State_Run function");
-		return FEAT_INCOMPAT;
+			2 : 1))) {
+		scanerr = "couldn't find State_Run function";
+		return;
 	}
-	if_cold (!(func = find_floatcall(func, 1, "Host_RunFrame"))) {
-		errmsg_errorx("couldn't find Host_RunFrame function");
-		return FEAT_INCOMPAT;
+	if_cold (!(func = find_floatcall(func, 1))) {
+		scanerr = "couldn't find Host_RunFrame function";
+		return;
 	}
-	if_cold (!(func = find_floatcall(func, 1, "_Host_RunFrame"))) {
-		errmsg_errorx("couldn't find _Host_RunFrame function");
-		return FEAT_INCOMPAT;
+	if_cold (!(func = find_floatcall(func, 1))) {
+		scanerr = "couldn't find _Host_RunFrame function";
+		return;
 	}
 	if_cold (!find_Host_AccumulateTime(func)) {
-		errmsg_errorx("couldn't find Host_AccumulateTime function");
+		scanerr = "couldn't find Host_AccumulateTime function";
+	}
+}
+
+INIT {
+	if_cold (scanerr) {
+		errmsg_errorx("%s", scanerr);
 		return FEAT_INCOMPAT;
 	}
 	struct hook_inline_featsetup_ret h = hook_inline_featsetup(
@@ -18,18 +18,43 @@
 #define INC_FASTFWD_H
 
 /*
- * Fast-forwards in-game time by a number of seconds, ignoring the usual
- * host_framerate and host_timescale settings. timescale controls how many
- * seconds of game time pass per real-time second.
+ * Fast-forwarding works through a queue of segments, each of which passes a
+ * number of seconds of game time at a given timescale (game seconds per real
+ * second), ignoring the usual host_framerate and host_timescale settings. A
+ * timescale of 1 instead lets the game run normally for that long, which is
+ * useful for pausing between faster segments. Durations are rounded to whole
+ * ticks, using the server's actual tick interval.
+ *
+ * A timescale of FASTFWD_ADAPTIVE picks the rate each frame based on how long
+ * previous frames took, aiming for the real time per frame set by the
+ * sst_fastfwd_budget cvar, within the range given by sst_fastfwd_minrate and
+ * sst_fastfwd_maxrate. This gets through things as quickly as the machine can
+ * manage without frames getting long enough to stutter.
+ *
+ * If a segment has a callback, it's called once the segment finishes, from the
+ * main thread. The callback may queue more segments.
  */
+
+#define FASTFWD_ADAPTIVE 0.0f
+
+/* Cancels any queued fast-forwarding and starts a single new segment. */
 void fastfwd(float seconds, float timescale);
 
 /*
- * Extends the length of an ongoing fast-forward (or otherwise does the same as
- * fastfwd() above). Overrides the existing timescale speed, for lack of better
- * idea of what to do.
+ * Adds a segment to the end of the queue, starting it immediately if the queue
+ * was empty. cb may be null. Returns false if the queue is full.
+ */
+bool fastfwd_queue(float seconds, float timescale, void (*cb)());
+
+/* Cancels all queued segments, without calling their callbacks. */
+void fastfwd_cancel();
+
+/*
+ * Replaces the remainder of the queue with a single segment covering the same
+ * total game time at the given timescale, keeping the last segment's callback.
+ * Returns false if nothing was queued.
  */
-void fastfwd_add(float seconds, float timescale);
+bool fastfwd_finish(float timescale);
 
 #endif
 
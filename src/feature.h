@@ -44,9 +44,10 @@
  * not be registered if SST is loaded by some other game.
  *
  * This also enables a build-time optimisation to elide REQUIRE_GAMEDATA()
- * checks as well as has_* conditionals. As such, it is wise to still specify
- * gamedata dependencies correctly, so that the definitions can be changed in
- * the data files without breaking code.
+ * checks as well as has_* conditionals, and to fold gamedata values which are
+ * known for certain given the tag into constants. As such, it is wise to still
+ * specify gamedata dependencies correctly, so that the definitions can be
+ * changed in the data files without breaking code.
  */
 #define GAMESPECIFIC(tag) \
 	/* impl note: see comment in gamedata.h */ \
@@ -160,6 +161,38 @@ enum {
  */
 #define PREINIT int _FEATURE_CAT(_feat_preinit_, MODULE_NAME)() // {...}
 
+/*
+ * Defines an optional scan function, which is run ahead of INIT to do slow but
+ * self-contained setup work - typically, finding functions and variables by
+ * walking through machine code. Scan functions of different features may be
+ * run concurrently on worker threads, each waiting only for those of features
+ * it depends on. Everything is joined before the first INIT is called.
+ *
+ * A scan function is only called if INIT would be (as far as GAMESPECIFIC(),
+ * REQUIRE_GAMEDATA() and REQUIRE_GLOBAL() are concerned), but INIT is still
+ * always responsible for deciding whether the feature actually works, usually
+ * by checking the results stored by the scan function.
+ *
+ * Since it may not be on the main thread, a scan function must ONLY read memory
+ * and write to its own module's variables. In particular, it must not print
+ * anything (including via errmsg or NEXT_INSN), register console stuff, hook
+ * functions, or call into the engine beyond looking up interfaces. Features
+ * that don't define this are simply initialised on the main thread as usual.
+ */
+#define SCAN void _FEATURE_CAT(_feat_scan_, MODULE_NAME)() // {...}
+
+/*
+ * Defines an optional function to be called on the main thread right before
+ * this feature's SCAN is scheduled, under the same conditions. This is where to
+ * do any lookups that the scan function itself isn't allowed to do, such as
+ * finding console commands to start disassembling from.
+ *
+ * Returns true if the scan should go ahead, or false if there's nothing to scan
+ * (in which case INIT still gets called, and should report the problem).
+ * Features using this macro must also define a SCAN block.
+ */
+#define PRESCAN bool _FEATURE_CAT(_feat_prescan_, MODULE_NAME)() // {...}
+
 #endif
 
 // vi: sw=4 ts=4 noet tw=80 cc=80
@@ -26,6 +26,13 @@
 __attribute((unused))
 static const int _gamedata_feattags;
 
+// used by generated code to constant-fold gamedata entries in each TU where
+// possible: a tag is known to match if it covers all the feature's tags, and
+// known not to match if it's defined as zero (i.e. it's not on this platform).
+#define _GAMEDATA_YES(feattags, tag) \
+	(!!(feattags) && ((feattags) & (tag)) == (feattags))
+#define _GAMEDATA_NO(tag) (!(tag))
+
 // STUPID HACK to avoid pollution if abi.h not already included (only because
 // generated gamedata stuff relies on this being defined)
 #ifndef NVDTOR
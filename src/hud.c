@@ -15,7 +15,11 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "chunklets/x86.h"
+#include "con_.h"
 #include "engineapi.h"
 #include "errmsg.h"
 #include "event.h"
@@ -95,13 +99,284 @@ static struct ISurface *matsurf;
 static struct IPanel *toolspanel;
 static struct IScheme *scheme;
 
+// the queued draw list. kinds are ordered by how they're drawn within a layer
+enum { CMD_FILLRECT, CMD_OUTLINERECT, CMD_LINE, CMD_TEXT };
+static struct hud_drawcmd queue[1024];
+static int nqueued = 0;
+
+static int cmpcmd(const void *a, const void *b) {
+	const struct hud_drawcmd *x = a, *y = b;
+	if (x->key != y->key) return x->key < y->key ? -1 : 1;
+	return x->seq - y->seq;
+}
+
+static void flushqueue() {
+	if (!nqueued) return;
+	qsort(queue, nqueued, sizeof(*queue), &cmpcmd);
+	// u64 max is never a valid key state, so the first of each always gets set
+	u64 colour = -1ull, textcolour = -1ull, font = -1ull;
+	for (const struct hud_drawcmd *c = queue; c < queue + nqueued; ++c) {
+		int kind = c->key >> 48 & 0xFF;
+		u64 newcolour = c->key & 0xFFFFFFFF;
+		struct rgba rgba = {.val = newcolour};
+		if (kind == CMD_TEXT) {
+			u64 newfont = c->key >> 32 & 0xFFFF;
+			if (newfont != font) {
+				DrawSetTextFont(matsurf, (struct handlewrap){newfont});
+				font = newfont;
+			}
+			if (newcolour != textcolour) {
+				DrawSetTextColor(matsurf, rgba);
+				textcolour = newcolour;
+			}
+			DrawSetTextPos(matsurf, c->x0, c->y0);
+			DrawPrintText(matsurf, (hud_wchar *)c->str, c->x1,
+					/*FONT_DRAW_DEFAULT*/ 0);
+			continue;
+		}
+		if (newcolour != colour) {
+			DrawSetColor(matsurf, rgba);
+			colour = newcolour;
+		}
+		switch_exhaust (kind) {
+			case CMD_FILLRECT:
+				DrawFilledRect(matsurf, c->x0, c->y0, c->x1, c->y1);
+				break;
+			case CMD_OUTLINERECT:
+				DrawOutlinedRect(matsurf, c->x0, c->y0, c->x1, c->y1);
+				break;
+			case CMD_LINE:
+				DrawLine(matsurf, c->x0, c->y0, c->x1, c->y1);
+		}
+	}
+	nqueued = 0;
+}
+
+static inline struct hud_drawcmd mkcmd(int layer, int kind, ulong font,
+		struct rgba colour, int x0, int y0, int x1, int y1,
+		const hud_wchar *str) {
+	return (struct hud_drawcmd){
+		.key = (u64)(layer & 0xFF) << 56 | (u64)kind << 48 |
+				(u64)(font & 0xFFFF) << 32 | colour.val,
+		.x0 = x0, .y0 = y0, .x1 = x1, .y1 = y1,
+		.str = str
+	};
+}
+
+static inline void enqueue(struct hud_drawcmd cmd) {
+	// if someone's drawing an absurd amount of stuff, just draw what we have
+	// so far. layering won't be perfect, but that's better than nothing.
+	if_cold (nqueued == countof(queue)) flushqueue();
+	cmd.seq = nqueued;
+	queue[nqueued++] = cmd;
+}
+
+void hud_queuerect(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour, bool fill) {
+	enqueue(mkcmd(layer, fill ? CMD_FILLRECT : CMD_OUTLINERECT, 0, colour,
+			x0, y0, x1, y1, 0));
+}
+
+void hud_queueline(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour) {
+	enqueue(mkcmd(layer, CMD_LINE, 0, colour, x0, y0, x1, y1, 0));
+}
+
+void hud_queuetext(int layer, ulong font, int x, int y, struct rgba colour,
+		const hud_wchar *str, int len) {
+	enqueue(mkcmd(layer, CMD_TEXT, font, colour, x, y, len, 0, str));
+}
+
+// element registry. each watched cvar maps back to its element so the change
+// callback knows what to mark dirty
+static struct hud_element *elems[16];
+static int nelems = 0;
+static struct { struct con_var *v; struct hud_element *e; } watches[64];
+static int nwatches = 0;
+static struct hud_element *curelem = 0; // the one being laid out, if any
+
+static void watchcb(struct con_var *v) {
+	for (int i = 0; i < nwatches; ++i) {
+		if (watches[i].v == v) watches[i].e->_dirty = true;
+	}
+}
+
+bool hud_addelement(struct hud_element *e, struct con_var *const *vars,
+		int nvars) {
+	if_cold (nelems == countof(elems) ||
+			nwatches + nvars > countof(watches)) {
+		errmsg_errorx("too many HUD elements");
+		return false;
+	}
+	for (int i = 0; i < nvars; ++i) {
+		vars[i]->cb = &watchcb;
+		watches[nwatches++] = (typeof(*watches)){vars[i], e};
+	}
+	e->_ncmds = 0;
+	e->_dirty = true;
+	elems[nelems++] = e;
+	return true;
+}
+
+static inline void cache(struct hud_drawcmd cmd) {
+	if_cold (curelem->_ncmds == curelem->maxcmds) return; // shouldn't happen
+	curelem->cmds[curelem->_ncmds++] = cmd;
+}
+
+void hud_cacherect(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour, bool fill) {
+	cache(mkcmd(layer, fill ? CMD_FILLRECT : CMD_OUTLINERECT, 0, colour,
+			x0, y0, x1, y1, 0));
+}
+
+void hud_cacheline(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour) {
+	cache(mkcmd(layer, CMD_LINE, 0, colour, x0, y0, x1, y1, 0));
+}
+
+void hud_cachetext(int layer, ulong font, int x, int y, struct rgba colour,
+		const hud_wchar *str, int len) {
+	cache(mkcmd(layer, CMD_TEXT, font, colour, x, y, len, 0, str));
+}
+
+static void drawelements(int width, int height, bool resized) {
+	for (int i = 0; i < nelems; ++i) {
+		struct hud_element *e = elems[i];
+		if (resized) e->_dirty = true;
+		if (e->enable && !con_getvari(e->enable)) continue;
+		if_cold (e->_dirty) {
+			e->_ncmds = 0;
+			curelem = e;
+			e->layout(width, height);
+			curelem = 0;
+			e->_dirty = false;
+		}
+		if (e->paint && !e->paint()) continue;
+		for (int j = 0; j < e->_ncmds; ++j) enqueue(e->cmds[j]);
+	}
+}
+
+// cache of UTF-8 strings converted to wide strings and measured in a given
+// font, for text that changes now and then but is drawn every frame. lookups
+// are a linear scan over the hashes, which is plenty fast at this size.
+#define TEXTCACHESZ 64
+#define TEXTMAX 128 // in bytes, including the null terminator
+static struct textent {
+	ulong font;
+	u32 hash;
+	uint lastuse; // for LRU eviction
+	uint frame; // entries used this frame can't be evicted, see hud.h
+	int len, w, h;
+	char key[TEXTMAX];
+	hud_wchar str[TEXTMAX]; // never needs more units than the UTF-8 has bytes
+} textcache[TEXTCACHESZ];
+static int ntextcache = 0;
+static uint textuses = 0, curframe = 0;
+static int lastw = 0, lasth = 0;
+
+// decodes as much of s as fits, replacing anything invalid with U+FFFD
+static int utf8towide(const char *s, int slen, hud_wchar *out) {
+	const uchar *p = (const uchar *)s, *end = p + slen;
+	int n = 0;
+	while (p < end) {
+		uint c = *p++, ncont;
+		if (c < 0x80) { out[n++] = c; continue; }
+		if (c >= 0xC2 && c < 0xE0) { c &= 0x1F; ncont = 1; }
+		else if (c >= 0xE0 && c < 0xF0) { c &= 0x0F; ncont = 2; }
+		else if (c >= 0xF0 && c < 0xF5) { c &= 0x07; ncont = 3; }
+		else { out[n++] = 0xFFFD; continue; }
+		uint i = 0;
+		for (; i < ncont && p < end && (*p & 0xC0) == 0x80; ++i, ++p) {
+			c = c << 6 | (*p & 0x3F);
+		}
+		// reject truncated, overlong, surrogate and out-of-range sequences
+		if_cold (i != ncont || c < (ncont == 1 ? 0x80 : ncont == 2 ? 0x800 :
+				0x10000) || (c >= 0xD800 && c < 0xE000) || c > 0x10FFFF) {
+			out[n++] = 0xFFFD;
+			continue;
+		}
+#ifdef _WIN32
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			out[n++] = 0xD800 | c >> 10;
+			out[n++] = 0xDC00 | (c & 0x3FF);
+			continue;
+		}
+#endif
+		out[n++] = c;
+	}
+	out[n] = 0;
+	return n;
+}
+
+static const struct textent *lookuptext(ulong font, const char *s) {
+	u32 h = 2166136261u; // FNV-1a
+	int len = 0;
+	for (; s[len] && len < TEXTMAX - 1; ++len) {
+		h = (h ^ (uchar)s[len]) * 16777619u;
+	}
+	struct textent *e = 0;
+	for (int i = 0; i < ntextcache; ++i) {
+		if (textcache[i].hash == h && textcache[i].font == font &&
+				!strncmp(textcache[i].key, s, len) && !textcache[i].key[len]) {
+			e = textcache + i;
+			goto r;
+		}
+	}
+	if (ntextcache < TEXTCACHESZ) {
+		e = textcache + ntextcache++;
+	}
+	else {
+		for (int i = 0; i < TEXTCACHESZ; ++i) {
+			if (textcache[i].frame == curframe) continue;
+			if (!e || textcache[i].lastuse < e->lastuse) e = textcache + i;
+		}
+		if_cold (!e) return 0; // more distinct strings this frame than fit!
+	}
+	e->font = font;
+	e->hash = h;
+	memcpy(e->key, s, len); e->key[len] = 0;
+	e->len = utf8towide(s, len, e->str);
+	GetTextSize(matsurf, (struct handlewrap){font}, e->str, &e->w, &e->h);
+r:	e->lastuse = ++textuses;
+	e->frame = curframe;
+	return e;
+}
+
+void hud_drawtext_utf8(ulong font, int x, int y, struct rgba colour,
+		const char *s) {
+	const struct textent *e = lookuptext(font, s);
+	if_cold (!e) return;
+	hud_drawtext(font, x, y, colour, (hud_wchar *)e->str, e->len);
+}
+
+void hud_queuetext_utf8(int layer, ulong font, int x, int y,
+		struct rgba colour, const char *s) {
+	const struct textent *e = lookuptext(font, s);
+	if_cold (!e) return;
+	hud_queuetext(layer, font, x, y, colour, e->str, e->len);
+}
+
+void hud_textsize_utf8(ulong font, const char *s, int *width, int *height) {
+	const struct textent *e = lookuptext(font, s);
+	if_cold (!e) { *width = 0; *height = 0; return; }
+	*width = e->w; *height = e->h;
+}
+
 typedef void (*VCALLCONV Paint_func)(struct IPanel *);
 static Paint_func orig_Paint;
 void VCALLCONV hook_Paint(struct IPanel *this) {
 	if (this == toolspanel) {
 		int width, height;
 		hud_screensize(&width, &height);
+		bool resized = width != lastw || height != lasth;
+		lastw = width; lasth = height;
+		// fonts get rescaled with the resolution, so cached sizes are stale
+		if_cold (resized) ntextcache = 0;
+		++curframe;
 		EMIT_HudPaint(width, height);
+		drawelements(width, height, resized);
+		flushqueue();
 	}
 	orig_Paint(this);
 }
@@ -18,6 +18,7 @@
 #ifndef INC_HUD_H
 #define INC_HUD_H
 
+#include "con_.h"
 #include "event.h"
 #include "engineapi.h"
 #include "intdefs.h"
@@ -68,6 +69,86 @@ void hud_drawpolyline(int *xs, int *ys, int npoints, struct rgba colour);
 void hud_drawtext(ulong font, int x, int y, struct rgba colour, hud_wchar *str,
 		int len);
 
+/*
+ * The following functions queue things to be drawn once every HudPaint handler
+ * has run, rather than drawing them immediately like the above. The queue is
+ * sorted so that things sharing a colour or font get drawn together, and any
+ * redundant colour and font changes are skipped, which saves a lot of vcalls
+ * when drawing more than a few things.
+ *
+ * Since that reorders things, anything that overlaps something else of a
+ * different colour has to go in a separate layer (0-255, drawn in ascending
+ * order). Within a layer, filled rectangles are drawn first, then outlines,
+ * then lines, then text, and otherwise anything with the same colour and font
+ * is drawn in the order it was queued.
+ *
+ * These must only be called from HudPaint handlers.
+ */
+void hud_queuerect(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour, bool fill);
+void hud_queueline(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour);
+/* N.B. str isn't copied, and must stay valid until the end of HudPaint. */
+void hud_queuetext(int layer, ulong font, int x, int y, struct rgba colour,
+		const hud_wchar *str, int len);
+
+/* An entry in a draw list. Should be treated as opaque. */
+struct hud_drawcmd {
+	u64 key; // layer, kind, font and colour, in that order of significance
+	int seq; // keeps submission order among identical keys, since qsort won't
+	int x0, y0, x1, y1; // for text, x1 is the length and y1 is unused
+	const hud_wchar *str;
+};
+
+/*
+ * A HUD element, which is a more structured alternative to handling HudPaint
+ * directly. An element's layout callback builds a draw list using the
+ * hud_cache*() functions below, and that list is then queued up every frame
+ * without any further work. The layout is only redone if the screen size or
+ * one of the element's cvars changes, so anything that can be worked out up
+ * front should be, to keep the per-frame path as short as possible.
+ */
+struct hud_element {
+	/* Optional cvar which must be nonzero for the element to be drawn. */
+	struct con_var *enable;
+	/* Called to rebuild the draw list. Should only use hud_cache*(). */
+	void (*layout)(int screenw, int screenh);
+	/*
+	 * Optional function called every frame before the cached list is drawn.
+	 * Can use hud_queue*() to draw anything that changes frame-to-frame, and
+	 * returns false to skip the cached list for the current frame.
+	 */
+	bool (*paint)();
+	/* Storage for the draw list, provided by the element. */
+	struct hud_drawcmd *cmds;
+	int maxcmds;
+	// private:
+	int _ncmds;
+	bool _dirty;
+};
+
+/*
+ * Registers a HUD element, and watches the given cvars for changes, which cause
+ * the element to be laid out again. This takes over the cvars' change callbacks
+ * (con_var.cb), so they must not have their own. Returns false on failure.
+ * Generally called from a feature's INIT.
+ */
+bool hud_addelement(struct hud_element *e, struct con_var *const *vars,
+		int nvars);
+
+/*
+ * Adds things to the draw list of the element currently being laid out. These
+ * follow the same rules as the hud_queue*() functions above, and may only be
+ * called from a hud_element's layout callback. Strings must remain valid for
+ * as long as the layout does.
+ */
+void hud_cacherect(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour, bool fill);
+void hud_cacheline(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour);
+void hud_cachetext(int layer, ulong font, int x, int y, struct rgba colour,
+		const hud_wchar *str, int len);
+
 /* Gets the width and height of the game window in pixels. */
 void hud_screensize(int *width, int *height);
 
@@ -80,4 +161,20 @@ int hud_charwidth(ulong font, hud_wchar ch);
 /* Gets the width and height of string s, in pixels, using the given font. */
 void hud_textsize(ulong font, const ushort *s, int *width, int *height);
 
+/*
+ * UTF-8 versions of hud_drawtext(), hud_queuetext() and hud_textsize(). These
+ * keep a small cache of recently used strings, so that text which is drawn
+ * every frame but only changes occasionally (timers, speed readouts, etc.) only
+ * gets converted and measured once. Strings longer than 127 bytes are cut off.
+ *
+ * Strings queued by hud_queuetext_utf8() are kept alive by the cache until the
+ * end of the frame. If a single frame uses more distinct strings than the cache
+ * can hold, the extra ones are skipped (and measure as 0x0).
+ */
+void hud_drawtext_utf8(ulong font, int x, int y, struct rgba colour,
+		const char *s);
+void hud_queuetext_utf8(int layer, ulong font, int x, int y,
+		struct rgba colour, const char *s);
+void hud_textsize_utf8(ulong font, const char *s, int *width, int *height);
+
 #endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "chunklets/fastspin.h"
+#include "initsched.h"
+#include "intdefs.h"
+#include "langext.h"
+
+// the main thread also takes tasks, so at most this many more get spawned. in
+// practice it'll be a lot fewer, since only a handful of features have SCANs.
+#define MAX_WORKERS 8
+
+static struct initsched_task *tasks;
+static int ntasks;
+static _Atomic int nexttask;
+
+static void runtasks() {
+	// tasks are claimed in order, and dependencies always come earlier in the
+	// array, so anything being waited on has already been claimed by a thread
+	// which is either running it or waiting on something earlier still. as
+	// such, this can never deadlock.
+	for (int i; i = atomic_fetch_add_explicit(&nexttask, 1,
+			memory_order_relaxed), i < ntasks;) {
+		struct initsched_task *t = tasks + i;
+		if (t->enabled) {
+			// N.B. dependencies are waited on even if they were disabled. it's
+			// up to each SCAN to cope with missing results from others, since
+			// it might just be a REQUEST() dependency anyway
+			for (int j = 0; j < t->ndeps; ++j) {
+				fastspin_wait(&tasks[t->deps[j]]._done);
+			}
+			t->f();
+		}
+		fastspin_raise(&t->_done, 1);
+	}
+}
+
+#ifdef _WIN32
+static ulong __stdcall workermain(void *unused) { runtasks(); return 0; }
+#else
+static void *workermain(void *unused) { runtasks(); return 0; }
+#endif
+
+static int ncpus() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#endif
+}
+
+void initsched_run(struct initsched_task *_tasks, int n) {
+	tasks = _tasks; ntasks = n;
+	atomic_store_explicit(&nexttask, 0, memory_order_relaxed);
+	int nenabled = 0;
+	for (int i = 0; i < n; ++i) {
+		tasks[i]._done = 0;
+		nenabled += tasks[i].enabled;
+	}
+	int nworkers = ncpus() - 1;
+	if (nworkers > nenabled - 1) nworkers = nenabled - 1;
+	if (nworkers > MAX_WORKERS) nworkers = MAX_WORKERS;
+	// if a thread fails to spawn, no big deal, the others will pick up the
+	// slack. worst case, everything just ends up running serially on this one.
+	int nspawned = 0;
+#ifdef _WIN32
+	void *thrs[MAX_WORKERS];
+	for (; nspawned < nworkers; ++nspawned) {
+		thrs[nspawned] = CreateThread(0, 0, &workermain, 0, 0, 0);
+		if (!thrs[nspawned]) break;
+	}
+	runtasks();
+	if (nspawned) WaitForMultipleObjects(nspawned, thrs, true, INFINITE);
+	for (int i = 0; i < nspawned; ++i) CloseHandle(thrs[i]);
+#else
+	pthread_t thrs[MAX_WORKERS];
+	for (; nspawned < nworkers; ++nspawned) {
+		if (pthread_create(thrs + nspawned, 0, &workermain, 0)) break;
+	}
+	runtasks();
+	for (int i = 0; i < nspawned; ++i) pthread_join(thrs[i], 0);
+#endif
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
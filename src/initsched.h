@@ -0,0 +1,44 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INC_INITSCHED_H
+#define INC_INITSCHED_H
+
+#include "intdefs.h"
+
+/*
+ * A task in the feature scan dependency graph. An array of these is generated
+ * by gluegen, one per feature with a SCAN block (see feature.h), in init order.
+ */
+struct initsched_task {
+	void (*f)();
+	const s16 *deps; /* indices of tasks which must finish before this one */
+	int ndeps;
+	bool enabled; /* set just before running; see generated scanfeatures() */
+	volatile int _done; // internal, for fastspin
+};
+
+/*
+ * Runs each enabled task in the array, spreading them across worker threads as
+ * far as dependencies allow, and returns when all of them have finished. Tasks
+ * must appear after all the tasks they depend on. If there's only one task to
+ * run, or only one CPU, everything simply runs on the calling thread.
+ */
+void initsched_run(struct initsched_task *tasks, int n);
+
+#endif
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
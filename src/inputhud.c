@@ -17,11 +17,15 @@
  */
 
 #include <math.h>
+#include <stdatomic.h>
+#include <string.h>
 
+#include "chunklets/msg.h"
 #include "chunklets/x86.h"
 #include "con_.h"
+#include "democustom.h"
+#include "demorec.h"
 #include "engineapi.h"
-#include "event.h"
 #include "errmsg.h"
 #include "feature.h"
 #include "gamedata.h"
@@ -32,6 +36,7 @@
 #include "intdefs.h"
 #include "langext.h"
 #include "mem.h"
+#include "sst.h"
 #include "vcall.h"
 #include "x86util.h"
 
@@ -42,6 +47,7 @@ REQUIRE_GAMEDATA(vtidx_GetUserCmd)
 REQUIRE_GAMEDATA(vtidx_VClient_DecodeUserCmdFromBuffer)
 REQUIRE_GLOBAL(factory_client)
 REQUIRE(hud)
+REQUEST(democustom)
 
 DEF_FEAT_CVAR(sst_inputhud, "Enable button input HUD", 0, CON_ARCHIVE)
 DEF_FEAT_CVAR(sst_inputhud_bgcolour_normal,
@@ -60,27 +66,28 @@ DEF_FEAT_CVAR_MINMAX(sst_inputhud_x,
 DEF_FEAT_CVAR_MINMAX(sst_inputhud_y,
 		"Input HUD y position (fraction between screen top and bottom)",
 		0.95, 0, 1, CON_ARCHIVE)
+DEF_FEAT_CVAR_MINMAX(sst_inputhud_timeline,
+		"Show a timeline of this many past inputs instead of the key grid",
+		0, 0, 256, CON_ARCHIVE)
+DEF_FEAT_CVAR(sst_inputhud_demo,
+		"Write input history into demos as they're recorded", 0, CON_ARCHIVE)
 
 static struct CInput { void **vtable; } *input;
 static int heldbuttons = 0, tappedbuttons = 0;
 
-static struct rgba colours[3] = {
-	{64, 64, 64, 140},
-	{16, 16, 16, 200},
-	{240, 240, 240, 255}
-};
+// history of recent usercmds, for the timeline and for demo streaming. only
+// ever written by the usercmd hooks; readers snapshot histhead and then read
+// backwards from there. since it's statically sized, recording never allocates.
+#define HISTSZ 256 // power of 2! also the max for sst_inputhud_timeline
+static struct sample {
+	int tick, buttons;
+	float fmove, smove;
+	short mousedx, mousedy;
+} history[HISTSZ];
+static _Atomic uint histhead = 0; // total number of samples ever recorded
+static uint histsent = 0; // how many of those have been written to a demo
 
-static void colourcb(struct con_var *v) {
-	if (v == sst_inputhud_bgcolour_normal) {
-		hexcolour_rgba(colours[0].bytes, con_getvarstr(v));
-	}
-	else if (v == sst_inputhud_bgcolour_pressed) {
-		hexcolour_rgba(colours[1].bytes, con_getvarstr(v));
-	}
-	else /* v == sst_inputhud_fg */ {
-		hexcolour_rgba(colours[2].bytes, con_getvarstr(v));
-	}
-}
+static struct rgba colours[3]; // normal, pressed, text; parsed in layout()
 
 struct CUserCmd {
 	void **vtable;
@@ -97,6 +104,70 @@ struct CUserCmd {
 	struct CUtlVector *entgroundcontact;
 };
 
+// encodes the samples not yet written to the demo, and writes them, at most
+// DEMOBATCH per packet. the format is a msgpack array of ["InputHistory",
+// [[tick, buttons, fmove, smove, mousedx, mousedy], ...]].
+#define DEMOBATCH 32
+static void senddemo(uint head) {
+	static uchar buf[DEMOBATCH * 27 + 32]; // 27 = max size of one sample
+	uchar *p = buf;
+	int n = head - histsent;
+	if (n > HISTSZ) { histsent = head - HISTSZ; n = HISTSZ; } // lost some
+	msg_putasz4(p, 2); p += 1;
+	msg_putssz5(p, 12); memcpy(p + 1, "InputHistory", 12); p += 13;
+	while (n) {
+		int batch = n > DEMOBATCH ? DEMOBATCH : n;
+		uchar *q = p;
+		q += msg_putasz16(q, batch);
+		for (int i = 0; i < batch; ++i, ++histsent) {
+			const struct sample *s = history + (histsent & (HISTSZ - 1));
+			msg_putasz4(q, 6); q += 1;
+			q += msg_puts32(q, s->tick);
+			q += msg_puts32(q, s->buttons);
+			msg_putf(q, s->fmove); q += 5;
+			msg_putf(q, s->smove); q += 5;
+			q += msg_puts16(q, s->mousedx);
+			q += msg_puts16(q, s->mousedy);
+		}
+		democustom_write(buf, q - buf);
+		n -= batch;
+	}
+}
+
+// called from the usercmd hooks, so should be kept very quick!
+static void record(const struct CUserCmd *cmd) {
+	// trick: to ensure every input (including scroll wheel) is displayed for at
+	// least a frame, even at sub-tickrate framerates, we accumulate tapped
+	// buttons with bitwise or. once these are drawn, tappedbuttons is cleared,
+	// but heldbuttons maintains its state, so stuff doesn't flicker constantly
+	heldbuttons = cmd->buttons; tappedbuttons |= cmd->buttons;
+	uint head = atomic_load_explicit(&histhead, memory_order_relaxed);
+	history[head & (HISTSZ - 1)] = (struct sample){
+		cmd->tick, cmd->buttons,
+		cmd->fmove, cmd->smove,
+		cmd->mousedx, cmd->mousedy
+	};
+	atomic_store_explicit(&histhead, ++head, memory_order_release);
+}
+
+// demo writing is done once per tick rather than from the hooks, which keeps
+// the hooks cheap, and means at most one tick's worth of input can be missed
+// when a demo is stopped.
+HANDLE_EVENT(Tick, bool simulating) {
+	uint head = atomic_load_explicit(&histhead, memory_order_acquire);
+	if (has_democustom && con_getvari(sst_inputhud_demo) &&
+			demorec_demonum() > 0) {
+		if (head != histsent) senddemo(head);
+	}
+	else {
+		histsent = head; // don't dump a load of old stuff in a new demo
+	}
+}
+
+HANDLE_EVENT(DemoRecordStarting) {
+	histsent = atomic_load_explicit(&histhead, memory_order_acquire);
+}
+
 #define vtidx_GetUserCmd_l4dbased vtidx_GetUserCmd
 DECL_VFUNC_DYN(struct CInput, struct CUserCmd *, GetUserCmd, int)
 DECL_VFUNC_DYN(struct CInput, struct CUserCmd *, GetUserCmd_l4dbased, int, int)
@@ -107,18 +178,14 @@ static void VCALLCONV hook_CreateMove(void *this, int seq, float ft,
 		bool active) {
 	orig_CreateMove(this, seq, ft, active);
 	struct CUserCmd *cmd = GetUserCmd(this, seq);
-	// trick: to ensure every input (including scroll wheel) is displayed for at
-	// least a frame, even at sub-tickrate framerates, we accumulate tapped
-	// buttons with bitwise or. once these are drawn, tappedbuttons is cleared,
-	// but heldbuttons maintains its state, so stuff doesn't flicker constantly
-	if (cmd) { heldbuttons = cmd->buttons; tappedbuttons |= cmd->buttons; }
+	if (cmd) record(cmd);
 }
 // basically a dupe, but calling the other version of GetUserCmd
 static void VCALLCONV hook_CreateMove_l4dbased(struct CInput *this, int seq,
 		float ft, bool active) {
 	orig_CreateMove(this, seq, ft, active);
 	struct CUserCmd *cmd = GetUserCmd_l4dbased(this, -1, seq);
-	if (cmd) { heldbuttons = cmd->buttons; tappedbuttons |= cmd->buttons; }
+	if (cmd) record(cmd);
 }
 
 typedef void (*VCALLCONV DecodeUserCmdFromBuffer_func)(struct CInput *,
@@ -136,13 +203,13 @@ static void VCALLCONV hook_DecodeUserCmdFromBuffer(struct CInput *this,
 		void *reader, int seq) {
 	orig_DecodeUserCmdFromBuffer(this, reader, seq);
 	struct CUserCmd *cmd = GetUserCmd(this, seq);
-	if (cmd) { heldbuttons = cmd->buttons; tappedbuttons |= cmd->buttons; }
+	if (cmd) record(cmd);
 }
 static void VCALLCONV hook_DecodeUserCmdFromBuffer_l4dbased(struct CInput *this,
 		int slot, void *reader, int seq) {
 	orig_DecodeUserCmdFromBuffer_l4dbased(this, slot, reader, seq);
 	struct CUserCmd *cmd = GetUserCmd_l4dbased(this, slot, seq);
-	if (cmd) { heldbuttons = cmd->buttons; tappedbuttons |= cmd->buttons; }
+	if (cmd) record(cmd);
 }
 
 static inline int bsf(uint x) {
@@ -307,9 +374,6 @@ static const char *const fontnames[] = {
 };
 static struct { ulong h; int sz; } fonts[countof(fontnames)];
 
-
-static int lastw = 0, lasth = 0;
-
 static void reloadfonts() {
 	for (int i = 0; i < countof(fontnames); ++i) {
 		if (fonts[i].h = hud_getfont(fontnames[i], true)) {
@@ -320,18 +384,75 @@ static void reloadfonts() {
 	}
 }
 
-HANDLE_EVENT(HudPaint, int screenw, int screenh) {
-	if (!con_getvari(sst_inputhud)) return;
-	if_cold (screenw != lastw || screenh != lasth) reloadfonts();
-	lastw = screenw; lasth = screenh;
+// the layout only changes with the screen size, fonts or the scale/position
+// cvars, so it's worked out up-front by the HUD element system. the labels (and
+// timeline backgrounds) are cached in its draw list, and the per-frame path
+// only has to add the boxes that depend on button state
+static struct hud_drawcmd cmds[countof(text) * 2];
+static int boxsz;
+static ulong font;
+static int nboxes;
+// in timeline mode, each box is a row, and x/y is the top left of its bar
+static struct box { int bit, bitidx, x, y, textx, texty; } boxes[countof(text)];
+static int timeline, colw, rowh; // timeline is the number of columns, or 0
+
+// one row per button with a label on the left, and the newest input on the
+// right. columns are an eighth of a box wide, rows are half a box high (or
+// enough for the text, if that's bigger)
+static void layouttimeline(int screenw, int screenh, int gap) {
+	colw = (boxsz + 7) / 8;
+	rowh = boxsz / 2;
+	int labelw = 0, th = 0;
+	if_hot (font) {
+		int fh = hud_fontheight(font);
+		if (fh > rowh) rowh = fh;
+	}
+	for (int mask = layout->mask, bitidx, bit; mask; mask ^= bit) {
+		bitidx = bsf(mask); bit = 1 << bitidx;
+		struct box *b = boxes + nboxes++;
+		b->bit = bit;
+		b->bitidx = bitidx;
+		if_hot (font) {
+			int tw;
+			hud_textsize(font, text[bitidx].s, &tw, &th);
+			b->textx = tw; // temporarily, to right-align below
+			if (tw > labelw) labelw = tw;
+		}
+	}
+	if (labelw) labelw += gap * 4;
+	int w = labelw + timeline * colw, h = nboxes * (rowh + gap) - gap;
+	int basex = roundf(con_getvarf(sst_inputhud_x) * (screenw - w));
+	int basey = roundf(con_getvarf(sst_inputhud_y) * (screenh - h));
+	for (int i = 0; i < nboxes; ++i) {
+		struct box *b = boxes + i;
+		b->x = basex + labelw;
+		b->y = basey + i * (rowh + gap);
+		b->textx = b->x - gap * 2 - b->textx;
+		b->texty = b->y + (rowh - th) / 2;
+		hud_cacherect(0, b->x, b->y, b->x + timeline * colw, b->y + rowh,
+				colours[0], true);
+		if_hot (font) {
+			hud_cachetext(1, font, b->textx, b->texty, colours[2],
+					text[b->bitidx].s, text[b->bitidx].len);
+		}
+	}
+}
+
+static void dolayout(int screenw, int screenh) {
+	hexcolour_rgba(colours[0].bytes,
+			con_getvarstr(sst_inputhud_bgcolour_normal));
+	hexcolour_rgba(colours[1].bytes,
+			con_getvarstr(sst_inputhud_bgcolour_pressed));
+	hexcolour_rgba(colours[2].bytes, con_getvarstr(sst_inputhud_fgcolour));
+	reloadfonts(); // resolution changes can change font sizes
 	int basesz = screenw > screenh ? screenw : screenh;
-	int boxsz = ceilf(basesz * 0.025f);
+	boxsz = ceilf(basesz * 0.025f);
 	if (boxsz < 24) boxsz = 24;
 	boxsz *= con_getvarf(sst_inputhud_scale);
 	int idealfontsz = boxsz - 8; // NOTE: this is overall text width, see INIT
-	ulong font = 0; int fontsz = 0;
+	int fontsz = 0;
+	font = 0;
 	// get the biggest font that'll fit the box
-	// XXX: can/should we avoid doing this every frame?
 	for (int i = 0; i < countof(fonts); ++i) {
 		// XXX: fonts aren't sorted... should we bother?
 		if_cold (!fonts[i].h) continue;
@@ -340,28 +461,83 @@ HANDLE_EVENT(HudPaint, int screenw, int screenh) {
 		//else break; // not sorted
 	}
 	int gap = (boxsz | 32) >> 5; // minimum 1 pixel gap
+	nboxes = 0;
+	if (timeline = con_getvari(sst_inputhud_timeline)) {
+		layouttimeline(screenw, screenh, gap);
+		return;
+	}
 	int w = (boxsz + gap) * layout->w / 2 - gap;
 	int h = (boxsz + gap) * layout->h / 2 - gap;
 	int basex = roundf(con_getvarf(sst_inputhud_x) * (screenw - w));
 	int basey = roundf(con_getvarf(sst_inputhud_y) * (screenh - h));
-	int buttons = heldbuttons | tappedbuttons;
 	for (int mask = layout->mask, bitidx, bit; mask; mask ^= bit) {
 		bitidx = bsf(mask); bit = 1 << bitidx;
+		struct box *b = boxes + nboxes++;
+		b->bit = bit;
+		b->bitidx = bitidx;
 		// divide sizes by 2 here to allow in-between positioning
-		int x = basex + layout->pos[bitidx].x * (boxsz + gap) / 2;
-		int y = basey + layout->pos[bitidx].y * (boxsz + gap) / 2;
-		hud_drawrect(x, y, x + boxsz, y + boxsz,
-				colours[!!(buttons & bit)], true);
+		b->x = basex + layout->pos[bitidx].x * (boxsz + gap) / 2;
+		b->y = basey + layout->pos[bitidx].y * (boxsz + gap) / 2;
 		if_hot (font) {
 			int tw, th;
 			hud_textsize(font, text[bitidx].s, &tw, &th);
-			hud_drawtext(font, x + (boxsz - tw) / 2, y + (boxsz - th) / 2,
-					colours[2], text[bitidx].s, text[bitidx].len);
+			b->textx = b->x + (boxsz - tw) / 2;
+			b->texty = b->y + (boxsz - th) / 2;
+			hud_cachetext(0, font, b->textx, b->texty, colours[2],
+					text[bitidx].s, text[bitidx].len);
+		}
+	}
+}
+
+// a long timeline full of rapid taps (e.g. scroll wheel spam) could otherwise
+// overflow hud.c's draw queue, which then gets flushed early and draws the bars
+// underneath the backgrounds. so, rows share a budget, and once a row runs out,
+// its oldest presses are just left off.
+#define TIMELINERECTS 512
+
+static void painttimeline() {
+	if_cold (!nboxes) return;
+	uint head = atomic_load_explicit(&histhead, memory_order_acquire);
+	int n = head < timeline ? head : timeline;
+	int off = timeline - n; // if there's not enough history yet
+	int maxrects = TIMELINERECTS / nboxes;
+	for (const struct box *b = boxes; b < boxes + nboxes; ++b) {
+		// draw each run of consecutive presses as a single rect, newest first
+		for (int i = n - 1, end = -1, nrects = 0; i >= -1; --i) {
+			bool pressed = i >= 0 &&
+					history[(head - n + i) & (HISTSZ - 1)].buttons & b->bit;
+			if (pressed) { if (end == -1) end = i + 1; continue; }
+			if (end == -1) continue;
+			hud_queuerect(1, b->x + (off + i + 1) * colw, b->y,
+					b->x + (off + end) * colw, b->y + rowh, colours[1], true);
+			if (++nrects == maxrects) break;
+			end = -1;
+		}
+	}
+}
+
+static bool paint() {
+	if (timeline) {
+		painttimeline();
+	}
+	else {
+		int buttons = heldbuttons | tappedbuttons;
+		for (const struct box *b = boxes; b < boxes + nboxes; ++b) {
+			hud_queuerect(0, b->x, b->y, b->x + boxsz, b->y + boxsz,
+					colours[!!(buttons & b->bit)], true);
 		}
 	}
 	tappedbuttons = 0;
+	return true;
 }
 
+static struct hud_element elem = {
+	.layout = &dolayout,
+	.paint = &paint,
+	.cmds = cmds,
+	.maxcmds = countof(cmds)
+};
+
 // find the CInput "input" global
 static inline bool find_input(struct VClient *vclient) {
 #ifdef _WIN32
@@ -420,9 +596,13 @@ INIT {
 	else if (GAMETYPE_MATCHES(L4D)) layout = &layout_l4d;
 	// TODO(compat): more game-specific layouts!
 
-	sst_inputhud_bgcolour_normal->cb = &colourcb;
-	sst_inputhud_bgcolour_pressed->cb = &colourcb;
-	sst_inputhud_fgcolour->cb = &colourcb;
+	elem.enable = sst_inputhud;
+	struct con_var *vars[] = {
+		sst_inputhud_bgcolour_normal, sst_inputhud_bgcolour_pressed,
+		sst_inputhud_fgcolour, sst_inputhud_scale, sst_inputhud_x,
+		sst_inputhud_y, sst_inputhud_timeline
+	};
+	if_cold (!hud_addelement(&elem, vars, countof(vars))) return FEAT_FAIL;
 
 	// Default HUD position would clash with L4D player health HUDs and
 	// HL2 sprint HUD, so move it up. This is a bit yucky, but at least we don't
@@ -21,6 +21,7 @@
 #include "con_.h"
 #include "errmsg.h"
 #include "feature.h"
+#include "gamedata.h"
 #include "gametype.h"
 #include "hook.h"
 #include "intdefs.h"
@@ -31,12 +32,11 @@
 
 FEATURE("Left 4 Dead 1 demo file backwards compatibility")
 GAMESPECIFIC(L4D1_1022plus)
+REQUIRE_GAMEDATA(off_CDemoFile_protocol)
 
 struct CDemoFile;
-// NOTE: not bothering to put this in gamedata since it's actually a constant.
-// We could optimise the gamedata system further to constant-fold things with no
-// leaves beyond the GAMESPECIFIC cutoff or whatever. But that sounds annoying.
-#define off_CDemoFile_protocol 272
+// NOTE: this gets constant-folded in here thanks to GAMESPECIFIC above, and the
+// REQUIRE_GAMEDATA check goes away at build time too.
 DEF_ACCESSORS(struct CDemoFile, int, CDemoFile_protocol)
 
 // L4D1 bumps the demo protocol version with every update to the game, which
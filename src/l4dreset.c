@@ -106,132 +106,50 @@ static inline void change(const char *missionid) {
 	ExecuteCommand(issue);
 }
 
-// Encoding: skip segment[, another[, another...]]. The last one is negative.
-// Cutscenes of same length can share an entry to save a few bytes :)
-static const schar ffsegs[] = {
-	- 9, // No Mercy; Ravenholm (short cutscene); Dam It Complete; Day Break;
-		 // Hard Rain: Downpour; Dead Before Dawn Too
-	  4, // Swamp Fever
-	  3, // - seen first propane
-	-12, // - second propane. Also: Death Toll; Dead Air (L4D1); Dark Carnival;
-		 // Cold Front; Riptide
-	-15, // Blood Harvest (L4D1); The Sacrifice (L4D1)
-	- 8, // Crash Course; Hard Rain; Left 4 Mario; Alley War
-	-13, // Dead Center; The Parish; Dead Air (L4D2); Dark Blood 2; Grey Scale;
-		 //	Tour of Terror; Carried Off; 2evileyes; Urban Flight; Detour Ahead;
-		 // Energy Crisis; Deadly Dispatch; Blood Proof; Centro
-	-10, // The Passing; Ceda Fever
-	 11, // The Sacrifice (L4D2)
-	- 4, // - view of biles
-	-16, // Blood Harvest (L4D2), The Last Stand
-	-18, // Cold Stream, Warcelona
-	- 7, // One 4 Nine
-	-14, // Roadkill; Haunted Forest; Suicide Blitz 2
-	-19, // Journey to Splash Mountain
-	-23, // Dark Woods (Extended)
-	-25, // Dark Carnival Remix
-	-28, // Diescraper Redux
-	-31, // Chernobyl: Chapter One, The Curse of Lazar Castle
-	-33, // RedemptionII
-	-36, // Deathcraft II
-	- 2, // Outrun
-	-11, // Arena of the Dead
-};
-#define FFIDX_NOMERCY 0
-#define FFIDX_RAVENHOLM 0
-#define FFIDX_DAMIT 0
-#define FFIDX_DAYBREAK 0
-#define FFIDX_HARDRAINREMIX 0
-#define FFIDX_DEADBEFOREDAWNTOO 0
-#define FFIDX_SWAMP 1
-#define FFIDX_DEATHTOLL 3
-#define FFIDX_DEADAIR_L4D1 3
-#define FFIDX_CARNIVAL 3
-#define FFIDX_COLDFRONT 3
-#define FFIDX_RIPTIDE 3
-#define FFIDX_HARVEST_L4D1 4
-#define FFIDX_SACRIFICE_L4D1 4
-#define FFIDX_CRASHCOURSE 5
-#define FFIDX_HARDRAIN 5
-#define FFIDX_MARIO 5
-#define FFIDX_ALLEYWAR 5
-#define FFIDX_CENTER 6
-#define FFIDX_PARISH 6
-#define FFIDX_DEADAIR_L4D2 6
-#define FFIDX_DARKBLOOD2 6
-#define FFIDX_GREYSCALE 6
-#define FFIDX_TOUROFTERROR 6
-#define FFIDX_CARRIEDOFF 6
-#define FFIDX_2EVILEYES 6
-#define FFIDX_URBANFLIGHT 6
-#define FFIDX_CITY17 6
-#define FFIDX_DETOURAHEAD 6
-#define FFIDX_ENERGYCRISIS 6
-#define FFIDX_DEADLYDISPATCH 6
-#define FFIDX_BLOODPROOF 6
-#define FFIDX_CENTRO 6
-#define FFIDX_PASSING 7
-#define FFIDX_CEDAFEVER 7
-#define FFIDX_SACRIFICE_L4D2 8
-#define FFIDX_HARVEST_L4D2 10
-#define FFIDX_TLS 10
-#define FFIDX_STREAM 11
-#define FFIDX_WARCELONA 11
-#define FFIDX_ONE4NINE 12
-#define FFIDX_ROADKILL 13
-#define FFIDX_HAUNTEDFOREST 13
-#define FFIDX_SUICIDEBLITZ2 13
-#define FFIDX_SPLASHMTN 14
-#define FFIDX_BLOODTRACKS 14
-#define FFIDX_DARKWOODS 15
-#define FFIDX_CARNIVALREMIX 16
-#define FFIDX_DIESCRAPER 17
-#define FFIDX_CHERNOBYL 18
-#define FFIDX_LAZARCASTLE 18
-#define FFIDX_REDEMPTIONII 19
-#define FFIDX_DEATHCRAFT 20
-#define FFIDX_OUTRUN 21
-#define FFIDX_ARENAOFTHEDEAD 22
+// cutscene timings are defined in gamedata/l4dcutscenes.txt, which gets built
+// into a perfect hash table keyed on the game and campaign name
+#include <l4dcutscenes.gen.h> // generated by build/mkcutscenes.c
 
-static schar ffidx;
-static short ffdelay = 0;
-static float ffadj = 0;
+static int pendingffidx = -1; // cutscene to fast-forward after a map change
+static bool pendingcontinue = false;
 static int nextmapnum = 0;
 
 DEF_FEAT_CVAR_MINMAX(sst_l4d_quickreset_peektime,
 		"Number of seconds to show each relevant item spot during fast-forward",
 		1.5, 0, 3, CON_ARCHIVE)
 
-DEF_FEAT_CCMD_HERE(sst_l4d_quickreset_continue,
-		"Get to the end of the current cutscene without further slowdowns", 0) {
-	if (!ffdelay) {
-		con_warn("not currently fast-forwarding a cutscene\n");
-		return;
+// queues up the whole fast-forward plan for a cutscene in one go, with a pause
+// of delay seconds first to let things settle. each intermediate point of
+// interest gets a normal-speed window, half of which comes just before it.
+static void queuecutscene(int idx, float delay) {
+	float halfwin = con_getvarf(sst_l4d_quickreset_peektime) / 2.0f;
+	bool ok = fastfwd_queue(delay, 1, 0);
+	// if first seg, just take half window. otherwise half + adj = full
+	float adj = 0;
+	for (; ffsegs[idx] > 0; ++idx) {
+		ok &= fastfwd_queue(ffsegs[idx] - adj - halfwin, FASTFWD_ADAPTIVE, 0);
+		ok &= fastfwd_queue(adj + halfwin, 1, 0);
+		adj = halfwin;
+	}
+	ok &= fastfwd_queue(-ffsegs[idx] - adj, FASTFWD_ADAPTIVE, 0);
+	// if the length is random, play out the rest at normal speed, since there's
+	// no way of knowing when it'll end. sst_l4d_quickreset_continue can be
+	// used to skip this if need be.
+	if (ffsegs[idx + 1]) ok &= fastfwd_queue(ffsegs[idx + 1], 1, 0);
+	// mkcutscenes limits segment counts to fit, so this should only happen if
+	// something else was already fast-forwarding. in any case, the queue is
+	// missing bits, so just get to the end as quickly as possible instead.
+	if_cold (!ok) {
+		errmsg_warnx("couldn't queue up all cutscene segments");
+		fastfwd_finish(FASTFWD_ADAPTIVE);
 	}
-	float remainder = ffdelay / 30.0f; // XXX: fixed tickrate... fine for now.
-	while (ffsegs[ffidx] > 0) remainder += ffsegs[ffidx++];
-	remainder -= ffsegs[ffidx];
-	ffdelay = 0;
-	fastfwd_add(remainder, 30);
 }
 
-HANDLE_EVENT(Tick, bool simulating) {
-	if (!nextmapnum && simulating && ffdelay && !--ffdelay) {
-		schar seg = ffsegs[ffidx];
-		float halfwin = con_getvarf(sst_l4d_quickreset_peektime) / 2.0f;
-		float t;
-		if (seg > 0) { // there's more after this one!
-			// if first seg, just take half window. otherwise half + adj = full
-			t = seg - ffadj - halfwin;
-			ffadj = halfwin;
-			++ffidx;
-			ffdelay = seg * 30; // XXX: fixed tickrate as above... fine for now.
-		}
-		else { // last one
-			t = -seg - ffadj;
-			ffadj = 0; // don't adjust the *next* fastforward's first seg
-		}
-		fastfwd(t, 30);
+DEF_FEAT_CCMD_HERE(sst_l4d_quickreset_continue,
+		"Get to the end of the current cutscene without further slowdowns", 0) {
+	if (pendingffidx != -1) { pendingcontinue = true; return; }
+	if (!fastfwd_finish(FASTFWD_ADAPTIVE)) {
+		con_warn("not currently fast-forwarding a cutscene\n");
 	}
 }
 
@@ -242,10 +160,17 @@ static void VCALLCONV hook_OnGameplayStart(struct CDirector *this) {
 	if (nextmapnum) {
 		// if we changed map more than 1 time, cancel the reset. this'll happen
 		// if someone prematurely disconnects and then starts a new session.
-		if (nextmapnum != gameserver_spawncount()) ffdelay = 0;
-		else reset(); // prevent bots walking around. note ffdelay is stil 45
+		if (nextmapnum == gameserver_spawncount()) {
+			reset(); // prevent bots walking around
+			if (pendingffidx != -1) {
+				queuecutscene(pendingffidx, 1.5f);
+				if (pendingcontinue) fastfwd_finish(FASTFWD_ADAPTIVE);
+			}
+		}
+		pendingffidx = -1;
+		pendingcontinue = false;
 	}
-	nextmapnum = 0; // resume countdown if there is one! otherwise do nothing.
+	nextmapnum = 0;
 }
 // Simply reuse the above for L4D1, since the calling ABI is the exact same!
 #define UnfreezeTeam_func OnGameplayStart_func
@@ -254,92 +179,15 @@ static void VCALLCONV hook_OnGameplayStart(struct CDirector *this) {
 #define hook_UnfreezeTeam hook_OnGameplayStart
 
 static int getffidx(const char *campaign) {
-	if (GAMETYPE_MATCHES(L4D1)) {
-		if (!strcmp(campaign, "Hospital")) return FFIDX_NOMERCY;
-		if (!strcmp(campaign, "SmallTown")) return FFIDX_DEATHTOLL;
-		if (!strcmp(campaign, "Airport")) return FFIDX_DEADAIR_L4D1;
-		if (!strcmp(campaign, "Farm")) return FFIDX_HARVEST_L4D1;
-		if (!strcmp(campaign, "River")) return FFIDX_SACRIFICE_L4D1;
-		if (!strcmp(campaign, "Garage")) return FFIDX_CRASHCOURSE;
-	}
-	else /* L4D2 */ {
-		if (!strncmp(campaign, "L4D2C", 5)) {
-			int ret;
-			switch (campaign[5]) {
-				case '1':
-					switch (campaign[6]) {
-						case '\0': return FFIDX_CENTER;
-						case '0': ret = FFIDX_DEATHTOLL; break;
-						case '1': ret = FFIDX_DEADAIR_L4D2; break;
-						case '2': ret = FFIDX_HARVEST_L4D2; break;
-						case '3': ret = FFIDX_STREAM; break;
-						case '4': ret = FFIDX_TLS; break;
-						default: return -1;
-					}
-					if (campaign[7]) return -1;
-					return ret;
-				case '2': ret = FFIDX_CARNIVAL; break;
-				case '3': ret = FFIDX_SWAMP; break;
-				case '4': ret = FFIDX_HARDRAIN; break;
-				case '5': ret = FFIDX_PARISH; break;
-				case '6': ret = FFIDX_PASSING; break;
-				case '7': ret = FFIDX_SACRIFICE_L4D2; break;
-				case '8': ret = FFIDX_NOMERCY; break;
-				case '9': ret = FFIDX_CRASHCOURSE; break;
-				default: return -1;
-			}
-			if (campaign[6]) return -1;
-			return ret;
-		}
-		// slow but uncommon case: this giant list of custom campaigns, for fun.
-		// TODO(opt): come up with something smart to do here on some rainy day?
-		if (!strcmp(campaign, "darkblood2")) return FFIDX_DARKBLOOD2;
-		if (!strcmp(campaign, "Greyscale")) return FFIDX_GREYSCALE;
-		if (!strcmp(campaign, "yomimario2")) return FFIDX_MARIO;
-		// TODO(compat): ravenholm cutscene length is actually random; this is
-		// the short one only. we'll want to solve that some day, somehow...
-		if (!strcmp(campaign, "ravenholmwar2")) return FFIDX_RAVENHOLM;
-		if (!strcmp(campaign, "warcelona")) return FFIDX_WARCELONA;
-		if (!strcmp(campaign, "tot")) return FFIDX_TOUROFTERROR;
-		if (!strcmp(campaign, "damitcomplete")) return FFIDX_DAMIT;
-		if (!strcmp(campaign, "CarriedOff")) return FFIDX_CARRIEDOFF;
-		if (!strcmp(campaign, "JourneyToSplashMountain")) return FFIDX_SPLASHMTN;
-		if (!strcmp(campaign, "rkls")) return FFIDX_ROADKILL;
-		if (!strcmp(campaign, "CedaFever")) return FFIDX_CEDAFEVER;
-		if (!strcmp(campaign, "coldfront")) return FFIDX_COLDFRONT;
-		if (!strcmp(campaign, "DarkCarnivalRemix")) return FFIDX_CARNIVALREMIX;
-		if (!strncmp(campaign, "DayBreak", 8)) {
-			if (campaign[8] == '\0' || !strcmp(campaign + 8, "v3")) {
-				return FFIDX_DAYBREAK;
-			}
-			return -1;
-		}
-		if (!strcmp(campaign, "Downpour")) return FFIDX_HARDRAINREMIX;
-		if (!strcmp(campaign, "red")) return FFIDX_REDEMPTIONII;
-		if (!strcmp(campaign, "Diescraper362")) return FFIDX_DIESCRAPER;
-		if (!strcmp(campaign, "dbd2")) return FFIDX_DEADBEFOREDAWNTOO;
-		if (!strcmp(campaign, "2evileyes")) return FFIDX_2EVILEYES;
-		if (!strcmp(campaign, "Chernobyl")) return FFIDX_CHERNOBYL;
-		if (!strcmp(campaign, "darkwood")) return FFIDX_DARKWOODS;
-		if (!strcmp(campaign, "TheCurseofLazarCastle")) return FFIDX_LAZARCASTLE;
-		if (!strcmp(campaign, "urbanflight")) return FFIDX_URBANFLIGHT;
-		if (!strcmp(campaign, "BloodTracks")) return FFIDX_BLOODTRACKS;
-		if (!strcmp(campaign, "City17l4d2")) return FFIDX_CITY17;
-		if (!strcmp(campaign, "Deathcraft")) return FFIDX_DEATHCRAFT;
-		if (!strcmp(campaign, "detourahead")) return FFIDX_DETOURAHEAD;
-		if (!strcmp(campaign, "hauntedforest")) return FFIDX_HAUNTEDFOREST;
-		if (!strcmp(campaign, "One4Nine")) return FFIDX_ONE4NINE;
-		if (!strcmp(campaign, "suicideblitz2")) return FFIDX_SUICIDEBLITZ2;
-		if (!strcmp(campaign, "energycrisis")) return FFIDX_ENERGYCRISIS;
-		if (!strcmp(campaign, "DDCW")) return FFIDX_DEADLYDISPATCH;
-		if (!strcmp(campaign, "Outrun")) return FFIDX_OUTRUN;
-		if (!strcmp(campaign, "BloodProof")) return FFIDX_BLOODPROOF;
-		if (!strcmp(campaign, "centro")) return FFIDX_CENTRO;
-		if (!strcmp(campaign, "riptide")) return FFIDX_RIPTIDE;
-		if (!strcmp(campaign, "jsarena2")) return FFIDX_ARENAOFTHEDEAD;
-		if (!strcmp(campaign, "AlleyWar")) return FFIDX_ALLEYWAR;
+	int game = GAMETYPE_MATCHES(L4D1) ? 1 : 2;
+	u32 h = ffcampaign_hash(game, campaign);
+	u32 disp = ffdisps[ffcampaign_mix(h, 0) & FFDISPS_MASK];
+	int slot = ffcampaign_mix(h, disp) & FFCAMPAIGNS_MASK;
+	if (ffcampaigns[slot].game != game ||
+			strcmp(ffcampaigns[slot].name, campaign)) {
+		return -1; // if unknown, just don't fast-forward, I guess.
 	}
-	return -1; // if unknown, just don't fast-forward, I guess.
+	return ffcampaigns[slot].idx;
 }
 
 DEF_FEAT_CVAR(sst_l4d_quickreset_fastfwd,
@@ -357,6 +205,9 @@ DEF_FEAT_CCMD_HERE(sst_l4d_quickreset,
 		con_warn("not hosting a server\n");
 		return;
 	}
+	fastfwd_cancel(); // in case a previous reset is still going
+	pendingffidx = -1;
+	pendingcontinue = false;
 	const char *campaign = l4dmm_curcampaign();
 	if (argc == 2 && (!campaign || strcasecmp(campaign, argv[1]))) {
 		change(argv[1]);
@@ -373,9 +224,13 @@ DEF_FEAT_CCMD_HERE(sst_l4d_quickreset,
 			nextmapnum = gameserver_spawncount() + 1; // same as above
 		}
 	}
+	int ffidx;
 	if (campaign && con_getvari(sst_l4d_quickreset_fastfwd) &&
 			(ffidx = getffidx(campaign)) != -1) {
-		ffdelay = 45; // 1.5s
+		// wait until the map's loaded if it's changing. otherwise, start after
+		// the rest of 1.5s, counting the fast-forward above
+		if (nextmapnum) pendingffidx = ffidx;
+		else queuecutscene(ffidx, 0.7f);
 	}
 	if (FinaleEscapeState) *FinaleEscapeState = 0; // see comment in INIT
 }
@@ -146,10 +146,8 @@ static const struct rgba
 static const struct vec3f zerovec = {0};
 
 static bool draw_testpos(struct vec3f start, struct vec3f testpos,
-		struct vec3f mins, struct vec3f maxs, bool needline) {
-	struct CGameTrace t = trace_hull(testpos, testpos, mins, maxs, PLAYERMASK,
-			&filter);
-	if (t.base.frac != 1.0f || t.base.allsolid || t.base.startsolid) {
+		struct vec3f mins, struct vec3f maxs, bool blocked, bool needline) {
+	if (blocked) {
 		AddBoxOverlay2(dbgoverlay, &testpos, &mins, &maxs, &zerovec,
 				&clear_face, &red_edge, 1000.0);
 		return needline;
@@ -157,7 +155,8 @@ static bool draw_testpos(struct vec3f start, struct vec3f testpos,
 	AddBoxOverlay2(dbgoverlay, &testpos, &mins, &maxs, &zerovec,
 			&clear_face, &yellow_edge, 1000.0);
 	if (needline) {
-		t = trace_line(start, testpos, PLAYERMASK, &filter);
+		struct CGameTrace t = trace_line_cached(start, testpos, PLAYERMASK,
+				&filter, filter.pass_ent);
 		AddLineOverlay(dbgoverlay, &start, &t.base.endpos,
 				orange_line.r, orange_line.g, orange_line.b, true, 1000.0);
 		// current knowledge indicates that this should never happen, but it's
@@ -172,6 +171,35 @@ static bool draw_testpos(struct vec3f start, struct vec3f testpos,
 	return false;
 }
 
+// tests every position along one axis in a single trace batch, then draws them
+static void draw_axis(struct vec3f start, struct vec3f step, int from, int to,
+		struct vec3f mins, struct vec3f maxs) {
+	// EntityPlacementTest tries at most 15 steps either way
+	struct vec3f pos[30], allmins[30], allmaxs[30];
+	uchar flags[30];
+	int n = 0;
+	for (int i = from; i <= to && n < countof(pos); ++i) {
+		if (i == 0) continue;
+		pos[n] = (struct vec3f){
+			start.x + step.x * i,
+			start.y + step.y * i,
+			start.z + step.z * i
+		};
+		allmins[n] = mins;
+		allmaxs[n] = maxs;
+		++n;
+	}
+	trace_hulls(n, pos, pos, allmins, allmaxs, PLAYERMASK, &filter,
+			&(struct trace_batchresults){.flags = flags});
+	bool needline = true;
+	for (int i = from, j = 0; i <= to && j < n; ++i) {
+		if (i == 0) { needline = true; continue; }
+		needline = draw_testpos(start, pos[j], mins, maxs, !!flags[j],
+				needline);
+		++j;
+	}
+}
+
 // note: UNREG because testwarp can still work without this
 DEF_CCMD_HERE_UNREG(sst_l4d_previewwarp, "Visualise bot warp unstuck logic "
 		"(use clear_debug_overlays to remove)", CON_SERVERSIDE | CON_CHEAT) {
@@ -247,24 +275,12 @@ DEF_CCMD_HERE_UNREG(sst_l4d_previewwarp, "Visualise bot warp unstuck logic "
 	}
 	AddBoxOverlay2(dbgoverlay, &stuckpos, &mins, &maxs, &zerovec,
 			&red_face, &red_edge, 1000.0);
-	bool needline = true;
-	for (int i = ranges.x.neg; i <= ranges.x.pos; ++i) {
-		if (i == 0) { needline = true; continue; }
-		struct vec3f pos = {stuckpos.x + step.x * i, stuckpos.y, stuckpos.z};
-		needline = draw_testpos(stuckpos, pos, mins, maxs, needline);
-	}
-	needline = true;
-	for (int i = ranges.y.neg; i <= ranges.y.pos; ++i) {
-		if (i == 0) { needline = true; continue; }
-		struct vec3f pos = {stuckpos.x, stuckpos.y + step.y * i, stuckpos.z};
-		needline = draw_testpos(stuckpos, pos, mins, maxs, needline);
-	}
-	needline = true;
-	for (int i = ranges.z.neg; i <= ranges.z.pos; ++i) {
-		if (i == 0) { needline = true; continue; }
-		struct vec3f pos = {stuckpos.x, stuckpos.y, stuckpos.z + step.z * i};
-		needline = draw_testpos(stuckpos, pos, mins, maxs, needline);
-	}
+	draw_axis(stuckpos, (struct vec3f){step.x, 0.0f, 0.0f},
+			ranges.x.neg, ranges.x.pos, mins, maxs);
+	draw_axis(stuckpos, (struct vec3f){0.0f, step.y, 0.0f},
+			ranges.y.neg, ranges.y.pos, mins, maxs);
+	draw_axis(stuckpos, (struct vec3f){0.0f, 0.0f, step.z},
+			ranges.z.neg, ranges.z.pos, mins, maxs);
 }
 
 static bool find_EntityPlacementTest(const uchar *insns) {
@@ -282,11 +298,11 @@ static bool find_EntityPlacementTest(const uchar *insns) {
 							p + 5 + mem_loads32(p + 1));
 					return true;
 				}
-				NEXT_INSN(p, "EntityPlacementTest function");
+				NEXT_INSN_QUIET(p);
 			}
 			return false;
 		}
-		NEXT_INSN(p, "EntityPlacementTest function");
+		NEXT_INSN_QUIET(p);
 	}
 #else
 #warning TODO(linux): usual asm search stuff
@@ -294,32 +310,52 @@ static bool find_EntityPlacementTest(const uchar *insns) {
 	return false;
 }
 
-static bool init_filter() {
+static CTraceFilterSimple_ctor filter_ctor = 0;
+static bool find_filter_ctor() {
 	const uchar *insns = (const uchar *)EntityPlacementTest;
 	for (const uchar *p = insns; p - insns < 0x60;) {
 		if (p[0] == X86_CALL) {
-			CTraceFilterSimple_ctor ctor = (CTraceFilterSimple_ctor)(
-					p + 5 + mem_loads32(p + 1));
-			// calling the constructor to fill the vtable and other members
-			// with values used by the engine. pass_ent is filled in runtime
-			ctor(&filter, 0, 8, 0);
+			filter_ctor = (CTraceFilterSimple_ctor)(p + 5 + mem_loads32(p + 1));
 			return true;
 		}
-		NEXT_INSN(p, "CTraceFilterSimple constructor");
+		NEXT_INSN_QUIET(p);
 	}
 	return false;
 }
 
-INIT {
+// N.B. the command lookup is done in PRESCAN on the main thread, while all the
+// searching is done in SCAN, possibly on another thread, which can't print
+// anything. errors are stashed here for INIT to report.
+static const uchar *z_add_insns = 0;
+static const char *scanerr = 0;
+
+PRESCAN {
 	struct con_cmd *z_add = con_findcmd("z_add");
-	if (!z_add || !find_EntityPlacementTest(z_add->cb_insns)) {
-		errmsg_errorx("couldn't find EntityPlacementTest function");
-		return FEAT_INCOMPAT;
+	if_cold (!z_add) {
+		scanerr = "couldn't find EntityPlacementTest function";
+		return false;
 	}
-	if (!init_filter()) {
-		errmsg_errorx("couldn't find trace filter ctor for EntityPlacementTest");
+	z_add_insns = z_add->cb_insns;
+	return true;
+}
+
+SCAN {
+	if_cold (!find_EntityPlacementTest(z_add_insns)) {
+		scanerr = "couldn't find EntityPlacementTest function";
+	}
+	else if_cold (!find_filter_ctor()) {
+		scanerr = "couldn't find trace filter ctor for EntityPlacementTest";
+	}
+}
+
+INIT {
+	if_cold (scanerr) {
+		errmsg_errorx("%s", scanerr);
 		return FEAT_INCOMPAT;
 	}
+	// calling the constructor to fill the vtable and other members with values
+	// used by the engine. pass_ent is filled in at runtime
+	filter_ctor(&filter, 0, 8, 0);
 	if_cold (!has_off_collision) {
 		errmsg_warnx("missing m_Collision gamedata - warp preview unavailable");
 	}
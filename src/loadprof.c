@@ -0,0 +1,150 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "con_.h"
+#include "errmsg.h"
+#include "intdefs.h"
+#include "langext.h"
+#include "loadprof.h"
+#include "os.h"
+
+// N.B. this file is only built with loadprof=1, which also defines SST_LOADPROF
+
+// a whole load is a couple hundred records at most right now; if it ever ends
+// up being more than this, the oldest ones just get overwritten. power of 2!
+#define NRECORDS 1024
+
+static struct record {
+	const char *name; // null for end records
+	vlong ts; // in OS-specific ticks
+} records[NRECORDS];
+static uint nrecords = 0; // total ever written; wraps around the buffer
+
+static inline vlong now() {
+#ifdef _WIN32
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ll + t.tv_nsec;
+#endif
+}
+
+static inline double tickstous(vlong ticks) {
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq); // n.b. only done when dumping, it's fine
+	return ticks * 1e6 / freq.QuadPart;
+#else
+	return ticks / 1e3;
+#endif
+}
+
+void loadprof_begin(const char *name) {
+	// name first, so the timestamp covers as little of our own overhead as
+	// possible (not that it should make much difference)
+	struct record *r = records + (nrecords++ & NRECORDS - 1);
+	r->name = name;
+	r->ts = now();
+}
+
+void loadprof_end() {
+	vlong ts = now();
+	struct record *r = records + (nrecords++ & NRECORDS - 1);
+	r->name = 0;
+	r->ts = ts;
+}
+
+struct writebuf {
+	int f, len;
+	bool err;
+	char buf[4096];
+};
+
+static void flush(struct writebuf *w) {
+	if (!w->err && w->len && os_write(w->f, w->buf, w->len) == -1) {
+		w->err = true;
+	}
+	w->len = 0;
+}
+
+static void putrecord(struct writebuf *w, const struct record *r, vlong base,
+		bool first) {
+	// names are all string literals from our own code, so no escaping needed
+	if (countof(w->buf) - w->len < 256) flush(w);
+	int len = snprintf(w->buf + w->len, countof(w->buf) - w->len,
+			"%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+			first ? "" : ",\n", r->name ? r->name : "", r->name ? 'B' : 'E',
+			tickstous(r->ts - base));
+	// clamp in case of a really long name; better a broken trace than a crash
+	int max = countof(w->buf) - w->len - 1;
+	w->len += len < max ? len : max;
+}
+
+DEF_CCMD_HERE(sst_loadprof_dump, "Write plugin load timings to a trace file "
+		"(Chrome JSON format)", 0) {
+	if (argc > 2) {
+		con_warn("usage: sst_loadprof_dump [filename]\n");
+		return;
+	}
+	const char *fname = argc == 2 ? argv[1] : "sst_loadprof.json";
+#ifdef _WIN32
+	ushort path[PATH_MAX];
+	if_cold (!MultiByteToWideChar(CP_UTF8, 0, fname, -1, path,
+			countof(path))) {
+		errmsg_errorsys("couldn't convert filename");
+		return;
+	}
+#else
+	const char *path = fname;
+#endif
+	struct writebuf w = {.f = os_open_writetrunc(path)};
+	if_cold (w.f == -1) { errmsg_errorsys("couldn't open %s", fname); return; }
+	uint n = nrecords, start = 0;
+	if (n > NRECORDS) { start = n - NRECORDS; n = NRECORDS; }
+	// skip any unmatched end records left over from a wrapped-around begin
+	uint i = start, depth = 0;
+	while (i < start + n && !records[i & NRECORDS - 1].name) ++i;
+	vlong base = i < start + n ? records[i & NRECORDS - 1].ts : 0;
+	memcpy(w.buf, "{\"traceEvents\":[\n", 17); w.len = 17;
+	uint nwritten = 0;
+	for (; i < start + n; ++i) {
+		const struct record *r = records + (i & NRECORDS - 1);
+		if (r->name) ++depth;
+		else if (!depth) continue;
+		else --depth;
+		putrecord(&w, r, base, !nwritten++);
+	}
+	if (countof(w.buf) - w.len < 4) flush(&w);
+	memcpy(w.buf + w.len, "\n]}\n", 4); w.len += 4;
+	flush(&w);
+	if_cold (w.err) errmsg_errorsys("couldn't write to %s", fname);
+	else con_msg("wrote %u load profiling records to %s\n", nwritten, fname);
+	os_close(w.f);
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
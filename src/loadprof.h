@@ -0,0 +1,54 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INC_LOADPROF_H
+#define INC_LOADPROF_H
+
+/*
+ * Optional startup timeline profiling. Built in only if SST_LOADPROF is defined
+ * (loadprof=1 in the compile scripts), in which case the stages of plugin load
+ * (including each feature's PREINIT and INIT) are timestamped into a fixed-size
+ * ring buffer, which can be written out as a Chrome trace file with the
+ * sst_loadprof_dump command and then viewed in about:tracing, Perfetto or
+ * similar. Otherwise, all of this compiles down to nothing.
+ *
+ * Stages may nest, but each LOADPROF_BEGIN() must be paired with a
+ * LOADPROF_END() on the same thread, which is expected to be the main thread.
+ */
+
+#ifdef SST_LOADPROF
+
+void loadprof_begin(const char *name);
+void loadprof_end();
+
+static inline int _loadprof_endint(int ret) { loadprof_end(); return ret; }
+
+#define LOADPROF_BEGIN(name) loadprof_begin(name)
+#define LOADPROF_END() loadprof_end()
+/* Times a call returning int (e.g. INIT) and evaluates to the call's result. */
+#define LOADPROF_INT(name, call) (loadprof_begin(name), _loadprof_endint(call))
+
+#else
+
+#define LOADPROF_BEGIN(name) ((void)0)
+#define LOADPROF_END() ((void)0)
+#define LOADPROF_INT(name, call) (call)
+
+#endif
+
+#endif
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
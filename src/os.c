@@ -74,6 +74,15 @@ void os_close(int f) {
 	CloseHandle((void *)(ssize)f);
 }
 
+const void *os_mapread(int f, int len) {
+	void *m = CreateFileMappingW((void *)(ssize)f, 0, PAGE_READONLY, 0, 0, 0);
+	if_cold (!m) return 0;
+	const void *ret = MapViewOfFile(m, FILE_MAP_READ, 0, 0, len);
+	CloseHandle(m); // the view keeps the mapping object alive by itself
+	return ret;
+}
+void os_unmap(const void *p, int len) { UnmapViewOfFile(p); }
+
 void os_getcwd(ushort buf[static 260]) { GetCurrentDirectoryW(260, buf); }
 
 bool os_mkdir(const ushort *path) { return CreateDirectoryW(path, 0); }
@@ -123,9 +132,15 @@ int os_read(int f, void *buf, int max) { return read(f, buf, max); }
 int os_write(int f, const void *buf, int max) { return write(f, buf, max); }
 void os_close(int f) { close(f); }
 
+const void *os_mapread(int f, int len) {
+	void *ret = mmap(0, len, PROT_READ, MAP_PRIVATE, f, 0);
+	return ret == MAP_FAILED ? 0 : ret;
+}
+void os_unmap(const void *p, int len) { munmap((void *)p, len); }
+
 vlong os_fsize(int f) {
 	struct stat s;
-	if_cold (stat(f, &s) == -1) return -1;
+	if_cold (fstat(f, &s) == -1) return -1;
 	return s.st_size;
 }
 
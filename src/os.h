@@ -179,6 +179,17 @@ long long os_fsize(int f);
  */
 void os_close(int f);
 
+/*
+ * Maps the first len bytes of the file referred to by OS-specific file handle f
+ * into memory, read-only. Returns a pointer to the mapped memory, or null on
+ * error. len must not be zero. The file handle may be closed straight away
+ * without affecting the mapping, which lasts until os_unmap() is called.
+ */
+const void *os_mapread(int f, int len);
+
+/* Unmaps memory previously mapped by os_mapread(), given the same length. */
+void os_unmap(const void *p, int len);
+
 /*
  * Gets the current working directory, which may be up to PATH_MAX characters in
  * length (using the OS-specific character type).
@@ -0,0 +1,195 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string.h>
+
+#include "accessor.h"
+#include "con_.h"
+#include "engineapi.h"
+#include "errmsg.h"
+#include "feature.h"
+#include "gamedata.h"
+#include "intdefs.h"
+#include "langext.h"
+#include "mem.h"
+#include "os.h"
+
+FEATURE("SendTable offset dumping")
+REQUIRE_GLOBAL(srvdll)
+REQUIRE_GAMEDATA(vtidx_GetAllServerClasses)
+REQUIRE_GAMEDATA(sz_SendProp)
+REQUIRE_GAMEDATA(off_SP_varname)
+REQUIRE_GAMEDATA(off_SP_type)
+REQUIRE_GAMEDATA(off_SP_offset)
+REQUIRE_GAMEDATA(off_SP_subtable)
+REQUIRE_GAMEDATA(DPT_DataTable)
+
+DEF_ARRAYIDX_ACCESSOR(struct SendProp, SendProp)
+DEF_ACCESSORS(struct SendProp, const char *, SP_varname)
+DEF_ACCESSORS(struct SendProp, int, SP_type)
+DEF_ACCESSORS(struct SendProp, int, SP_offset)
+DEF_ACCESSORS(struct SendProp, struct SendTable *, SP_subtable)
+
+// File format (see also tools/propdiff.c, which reads it), all little-endian:
+//
+//   magic "SSTPROPS", u8 version (currently 2)
+//   u16 nclasses, then for each ServerClass: u8 namelen, name, tableref
+//
+//   tableref: u16 index. if index is the number of tables seen so far, a new
+//   table follows: u8 namelen, name, u16 nprops, and for each prop:
+//     u8 namelen, name, u8 type, u8 isdatatable, s32 offset,
+//     and then if isdatatable, a tableref for the subtable (0xFFFF if null)
+//
+// Every table gets written exactly once no matter how many classes share it
+// (e.g. as a baseclass), which keeps the whole thing fairly small.
+
+#define FILEVER 2
+
+// maps SendTable pointers to their indices, so tables are only written once
+#define MAXTABLES 16384 // power of 2!
+static const struct SendTable *tableptrs[MAXTABLES];
+static u16 tableidxs[MAXTABLES];
+static int ntables;
+
+struct writer {
+	int f;
+	int len;
+	bool err;
+	uchar buf[16384];
+};
+
+static void flush(struct writer *w) {
+	if (!w->err && w->len && os_write(w->f, w->buf, w->len) == -1) {
+		w->err = true;
+	}
+	w->len = 0;
+}
+
+static void put(struct writer *w, const void *p, int len) {
+	if (countof(w->buf) - w->len < len) flush(w);
+	memcpy(w->buf + w->len, p, len); // n.b. len is always small
+	w->len += len;
+}
+
+static inline void putu8(struct writer *w, uchar x) { put(w, &x, 1); }
+static inline void putu16(struct writer *w, u16 x) { put(w, &x, 2); } // x86=LE
+static inline void puts32(struct writer *w, s32 x) { put(w, &x, 4); } // "
+
+static void putname(struct writer *w, const char *s) {
+	int len = s ? strlen(s) : 0;
+	if_cold (len > 255) len = 255; // if this ever happens, something is weird
+	putu8(w, len);
+	if (len) put(w, s, len);
+}
+
+static bool puttable(struct writer *w, const struct SendTable *st) {
+	if (!st) { putu16(w, 0xFFFF); return true; }
+	uint h = ((usize)st >> 2) * 2654435761u; // Knuth-ish multiplicative hash
+	for (uint i = h;; ++i) {
+		i &= MAXTABLES - 1;
+		if (tableptrs[i] == st) { putu16(w, tableidxs[i]); return true; }
+		if (!tableptrs[i]) {
+			// n.b. leaving some slack keeps probe sequences short
+			if_cold (ntables == MAXTABLES / 2) return false;
+			tableptrs[i] = st;
+			tableidxs[i] = ntables;
+			break;
+		}
+	}
+	putu16(w, ntables++);
+	putname(w, st->tablename);
+	putu16(w, st->nprops);
+	for (int i = 0; i < st->nprops; ++i) {
+		const struct SendProp *p = arrayidx_SendProp(st->props, i);
+		// prefetch the next one while we're busy chasing the name pointer
+		__builtin_prefetch(arrayidx_SendProp(st->props, i + 1));
+		putname(w, get_SP_varname(p));
+		int type = get_SP_type(p);
+		bool isdt = type == DPT_DataTable;
+		putu8(w, type);
+		putu8(w, isdt);
+		puts32(w, get_SP_offset(p));
+		if (isdt && !puttable(w, get_SP_subtable(p))) return false;
+	}
+	return true;
+}
+
+DEF_FEAT_CCMD_HERE(sst_propdump, "Write all ServerClass/SendTable data to a "
+		"binary file, for comparing with tools/propdiff", 0) {
+	if (argc != 2) {
+		con_warn("usage: sst_propdump filename\n");
+		return;
+	}
+#ifdef _WIN32
+	ushort path[PATH_MAX];
+	if_cold (!MultiByteToWideChar(CP_UTF8, 0, argv[1], -1, path,
+			countof(path))) {
+		errmsg_errorsys("couldn't convert filename");
+		return;
+	}
+#else
+	const char *path = argv[1];
+#endif
+	static struct writer w; // a bit big for the stack
+	w = (struct writer){.f = os_open_writetrunc(path)};
+	if_cold (w.f == -1) {
+		errmsg_errorsys("couldn't open %s", argv[1]);
+		return;
+	}
+	memset(tableptrs, 0, sizeof(tableptrs));
+	ntables = 0;
+	put(&w, "SSTPROPS", 8);
+	putu8(&w, FILEVER);
+	// count up front rather than using a terminator, since names could in
+	// theory be empty and the reader would then stop early
+	const struct ServerClass *classes = engineapi_serverclasses();
+	int nclasses = 0;
+	for (const struct ServerClass *class = classes; class;
+			class = class->next) {
+		++nclasses;
+	}
+	if_cold (nclasses > 65535) {
+		errmsg_errorx("too many ServerClasses to dump");
+		goto e;
+	}
+	putu16(&w, nclasses);
+	for (const struct ServerClass *class = classes; class;
+			class = class->next) {
+		__builtin_prefetch(class->next);
+		putname(&w, class->name);
+		if_cold (!puttable(&w, class->table)) {
+			errmsg_errorx("too many SendTables to dump");
+			goto e;
+		}
+	}
+	flush(&w);
+	if_cold (w.err) {
+		errmsg_errorsys("couldn't write to %s", argv[1]);
+		goto e;
+	}
+	con_msg("wrote %d classes and %d tables to %s\n", nclasses, ntables,
+			argv[1]);
+e:	os_close(w.f);
+}
+
+INIT {
+	return FEAT_OK;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
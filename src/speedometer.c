@@ -0,0 +1,129 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <math.h>
+
+#include "accessor.h"
+#include "con_.h"
+#include "engineapi.h"
+#include "ent.h"
+#include "event.h"
+#include "feature.h"
+#include "gamedata.h"
+#include "hexcolour.h"
+#include "hud.h"
+#include "intdefs.h"
+#include "langext.h"
+#include "sst.h"
+
+FEATURE("speedometer HUD")
+REQUIRE(ent)
+REQUIRE(hud)
+REQUIRE_GAMEDATA(off_velocity)
+REQUIRE_GLOBAL(globalvars)
+
+DEF_FEAT_CVAR(sst_speedometer, "Enable speedometer HUD", 0, CON_ARCHIVE)
+DEF_FEAT_CVAR(sst_speedometer_colour, "Speedometer text colour (RGBA hex)",
+		"F0F0F0FF", CON_ARCHIVE)
+DEF_FEAT_CVAR_MINMAX(sst_speedometer_x,
+		"Speedometer x position (fraction between screen left and right)",
+		0.5, 0, 1, CON_ARCHIVE)
+DEF_FEAT_CVAR_MINMAX(sst_speedometer_y,
+		"Speedometer y position (fraction between screen top and bottom)",
+		0.6, 0, 1, CON_ARCHIVE)
+DEF_FEAT_CVAR(sst_speedometer_vertical,
+		"Include vertical velocity in speedometer reading", 0, CON_ARCHIVE)
+
+DEF_ACCESSORS(void, struct vec3f, velocity)
+DEF_ACCESSORS(struct CGlobalVars, float, realtime)
+DEF_ACCESSORS(struct CGlobalVars, float, tickinterval)
+
+// velocity is sampled once per tick, so nothing has to look up the player
+// entity at frame rate. the HUD then interpolates between the last two samples
+// to avoid stepping at framerates above the tickrate. power of 2!
+#define NSAMPLES 4
+static struct { struct vec3f vel; float time; } samples[NSAMPLES];
+static uint nsamples = 0; // total ever recorded; wraps around the buffer
+
+HANDLE_EVENT(Tick, bool simulating) {
+	if (!simulating || !con_getvari(sst_speedometer)) return;
+	void *e = ent_get(1); // TODO(compat): only handles the local SP player
+	if_cold (!e) return;
+	uint i = nsamples & NSAMPLES - 1;
+	samples[i].vel = get_velocity(e);
+	samples[i].time = get_realtime(globalvars);
+	++nsamples;
+}
+
+HANDLE_EVENT(LevelShutdown) {
+	nsamples = 0;
+}
+
+static ulong font;
+static struct rgba colour;
+static int screenw, screenh;
+
+static void layout(int w, int h) {
+	screenw = w; screenh = h;
+	hexcolour_rgba(colour.bytes, con_getvarstr(sst_speedometer_colour));
+	if (!(font = hud_getfont("Default", true))) {
+		font = hud_getfont("DefaultSmall", true);
+	}
+}
+
+static bool paint() {
+	if_cold (!font || !nsamples) return false;
+	uint n = nsamples;
+	const struct vec3f *cur = &samples[(n - 1) & NSAMPLES - 1].vel;
+	const struct vec3f *prev = n > 1 ? &samples[(n - 2) & NSAMPLES - 1].vel :
+			cur;
+	float t = (get_realtime(globalvars) - samples[(n - 1) & NSAMPLES - 1].time)
+			/ get_tickinterval(globalvars);
+	if (!(t > 0)) t = 0; else if (t > 1) t = 1; // (also catches NaN)
+	float x = prev->x + (cur->x - prev->x) * t;
+	float y = prev->y + (cur->y - prev->y) * t;
+	float sq = x * x + y * y;
+	if (con_getvari(sst_speedometer_vertical)) {
+		float z = prev->z + (cur->z - prev->z) * t;
+		sq += z * z;
+	}
+	// format by hand - this is simple enough and saves pulling in printf. the
+	// value is rounded to whole units, which also keeps the text cache happy.
+	char buf[12], *p = buf + sizeof(buf);
+	*--p = '\0';
+	uint speed = roundf(sqrtf(sq));
+	do *--p = '0' + speed % 10; while (speed /= 10);
+	int w, h;
+	hud_textsize_utf8(font, p, &w, &h);
+	int basex = roundf(con_getvarf(sst_speedometer_x) * (screenw - w));
+	int basey = roundf(con_getvarf(sst_speedometer_y) * (screenh - h));
+	hud_queuetext_utf8(0, font, basex, basey, colour, p);
+	return false; // nothing is cached, no need to bother with the empty list
+}
+
+static struct hud_element elem = {
+	.layout = &layout,
+	.paint = &paint
+};
+
+INIT {
+	elem.enable = sst_speedometer;
+	struct con_var *vars[] = {sst_speedometer_colour};
+	if_cold (!hud_addelement(&elem, vars, countof(vars))) return FEAT_FAIL;
+	return FEAT_OK;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
@@ -0,0 +1,89 @@
+/*
+ * Copyright © Michael Smith <mikesmiffy128@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INC_SPSCRING_H
+#define INC_SPSCRING_H
+
+#include <stdatomic.h>
+
+#include "chunklets/cacheline.h"
+#include "intdefs.h"
+
+/*
+ * Defines a fixed-size, lock-free ring buffer type `struct name`, holding up to
+ * size elements of the given type, for passing things from exactly one producer
+ * thread to exactly one consumer thread. size must be a power of 2.
+ *
+ * The producer and consumer each keep their index (and a cached copy of the
+ * other's) on their own cache line, so neither side touches the other's line
+ * unless the ring looks full or empty, respectively. This makes pushing cheap
+ * enough to do from places with hard timing limits, like input hooks.
+ *
+ * The following functions are defined along with the struct:
+ *
+ *   bool name_push(struct name *r, type val)
+ *     Producer only. Adds val to the ring. Returns false if the ring is full,
+ *     in which case val is dropped.
+ *
+ *   int name_pop(struct name *r, type *out, int max)
+ *     Consumer only. Removes up to max elements from the ring, oldest first,
+ *     and copies them to out. Returns the number of elements removed.
+ *
+ * A zero-initialised struct is an empty ring.
+ */
+#define DEF_SPSCRING(name, type, size) \
+	_Static_assert(!((size) & ((size) - 1)), "ring size must be power of 2"); \
+	struct name { \
+		struct { \
+			_Atomic uint tail; \
+			uint headcache; \
+		} _Alignas(CACHELINE_FALSESHARE_SIZE) prod; \
+		struct { \
+			_Atomic uint head; \
+			uint tailcache; \
+		} _Alignas(CACHELINE_FALSESHARE_SIZE) cons; \
+		_Alignas(CACHELINE_FALSESHARE_SIZE) typeof(type) buf[size]; \
+	}; \
+	\
+	static inline bool name##_push(struct name *r, typeof(type) val) { \
+		uint t = atomic_load_explicit(&r->prod.tail, memory_order_relaxed); \
+		if (t - r->prod.headcache == (size)) { \
+			r->prod.headcache = atomic_load_explicit(&r->cons.head, \
+					memory_order_acquire); \
+			if (t - r->prod.headcache == (size)) return false; \
+		} \
+		r->buf[t & ((size) - 1)] = val; \
+		atomic_store_explicit(&r->prod.tail, t + 1, memory_order_release); \
+		return true; \
+	} \
+	\
+	static inline int name##_pop(struct name *r, typeof(type) *out, int max) { \
+		uint h = atomic_load_explicit(&r->cons.head, memory_order_relaxed); \
+		if (h == r->cons.tailcache) { \
+			r->cons.tailcache = atomic_load_explicit(&r->prod.tail, \
+					memory_order_acquire); \
+			if (h == r->cons.tailcache) return 0; \
+		} \
+		uint n = r->cons.tailcache - h; \
+		if (n > (uint)max) n = max; \
+		for (uint i = 0; i < n; ++i) out[i] = r->buf[(h + i) & ((size) - 1)]; \
+		atomic_store_explicit(&r->cons.head, h + n, memory_order_release); \
+		return n; \
+	}
+
+#endif
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
@@ -28,6 +28,7 @@
 #include "engineapi.h"
 #include "errmsg.h"
 #include "event.h"
+#include "evprof.h" // for generated code
 #include "extmalloc.h" // for freevars() in generated code
 #include "feature.h"
 #include "fixes.h"
@@ -35,8 +36,10 @@
 #include "gameinfo.h"
 #include "gametype.h"
 #include "hook.h"
+#include "initsched.h" // for generated code
 #include "intdefs.h"
 #include "langext.h"
+#include "loadprof.h"
 #include "os.h"
 #include "sst.h"
 #include "vcall.h"
@@ -61,7 +64,7 @@ bool sst_userunloaded = false; // see hook_plugin_unload_cb() below
 
 #ifdef _WIN32
 extern long __ImageBase; // this is actually the PE header struct but don't care
-static inline void *ownhandle() { return &__ImageBase; }
+void *sst_ownhandle() { return &__ImageBase; }
 #else
 // sigh, _GNU_SOURCE crap. define here instead >:(
 typedef struct {
@@ -71,11 +74,12 @@ typedef struct {
 	void *dli_saddr;
 } Dl_info;
 int dladdr1(const void *addr, Dl_info *info, void **extra_info, int flags);
-static void *ownhandle() {
+void *sst_ownhandle() {
 	static void *cached = 0;
 	Dl_info dontcare;
 	if_cold (!cached) {
-		dladdr1((void *)&ownhandle, &dontcare, &cached, /*RTLD_DL_LINKMAP*/ 2);
+		dladdr1((void *)&sst_ownhandle, &dontcare, &cached,
+				/*RTLD_DL_LINKMAP*/ 2);
 	}
 	return cached;
 }
@@ -93,7 +97,7 @@ static inline bool checksamedrive(const ushort *restrict path1,
 
 DEF_CCMD_HERE(sst_autoload_enable, "Register SST to load on game startup", 0) {
 	os_char path[PATH_MAX];
-	if_cold (os_dlfile(ownhandle(), path, countof(path)) == -1) {
+	if_cold (os_dlfile(sst_ownhandle(), path, countof(path)) == -1) {
 		// hopefully by this point this won't happen, but, like, never know
 		errmsg_errordl("failed to get path to plugin");
 		return;
@@ -247,7 +251,6 @@ out in DEF_CVAR - better yet, can we get rid of this yet?
 DEF_CVAR(__sst_0_17_beta, "", 0, CON_INIT_HIDDEN | CON_DEMO)
 
 // most plugin callbacks are unused - define dummy functions for each signature
-static void VCALLCONV nop_v_v(void *this) {}
 static void VCALLCONV nop_p_v(void *this, void *p) {}
 static void VCALLCONV nop_pp_v(void *this, void *p1, void *p2) {}
 static void VCALLCONV nop_pii_v(void *this, void *p, int i1, int i2) {}
@@ -310,7 +313,10 @@ static inline void successbanner() { // called by generated code
 #include <glue.gen.h> // generated by build/gluegen.c
 
 static void do_featureinit() {
+	LOADPROF_BEGIN("do_featureinit");
+	LOADPROF_BEGIN("engineapi_lateinit");
 	engineapi_lateinit();
+	LOADPROF_END();
 	// load libs that might not be there early (...at least on Linux???)
 	clientlib = os_dlhandle(OS_LIT("client") OS_LIT(OS_DLSUFFIX));
 	if_cold (!clientlib) {
@@ -333,7 +339,10 @@ static void do_featureinit() {
 		}
 	}
 	// ... and now for the real magic! (n.b. this also registers feature cvars)
+	LOADPROF_BEGIN("initfeatures");
 	initfeatures();
+	LOADPROF_END();
+	LOADPROF_END();
 #ifdef SST_DBG
 	struct rgba purple = {192, 128, 240, 255};
 	con_colourmsg(&purple, "Matched gametype tags: ");
@@ -546,7 +555,10 @@ static bool do_load(ifacefactory enginef, ifacefactory serverf) {
 		return false;
 	}
 	factory_engine = enginef; factory_server = serverf;
-	if_cold (!engineapi_init(ifacever)) return false;
+	LOADPROF_BEGIN("engineapi_init");
+	bool ok = engineapi_init(ifacever);
+	LOADPROF_END();
+	if_cold (!ok) return false;
 	if (GAMETYPE_MATCHES(OE)) shuntvars(); // see also comment in con_detect()
 	const void **p = vtable_firstdiff;
 	if (GAMETYPE_MATCHES(Portal2)) *p++ = (void *)&nop_p_v; // ClientFullyConnect
@@ -561,8 +573,13 @@ static bool do_load(ifacefactory enginef, ifacefactory serverf) {
 	*p++ = (void *)&nop_ipipp_v;	  // OnQueryCvarValueFinished (002+)
 	*p++ = (void *)&nop_p_v;		  // OnEdictAllocated
 	*p   = (void *)&nop_p_v;		  // OnEdictFreed
+	LOADPROF_BEGIN("preinitfeatures");
 	preinitfeatures();
-	if (!deferinit()) { do_featureinit(); fixes_apply(); }
+	LOADPROF_END();
+	LOADPROF_BEGIN("deferinit");
+	bool deferred = deferinit();
+	LOADPROF_END();
+	if (!deferred) { do_featureinit(); fixes_apply(); }
 	if_hot (pluginhandler) {
 		cmd_plugin_load = con_findcmd("plugin_load");
 		hook_plugin_load_cb(cmd_plugin_load);
@@ -594,8 +611,8 @@ static void do_unload() {
 		// anything about that though.
 		struct CPlugin *plugin = plugins[ownidx];
 		switch_exhaust (detectpluginver(plugin)) {
-			case 1: plugin->v1.module = ownhandle(); break;
-			case 2: plugin->v2.module = ownhandle(); break;
+			case 1: plugin->v1.module = sst_ownhandle(); break;
+			case 2: plugin->v2.module = sst_ownhandle(); break;
 			case 3:;
 		}
 #endif
@@ -636,6 +653,7 @@ static const char *VCALLCONV GetPluginDescription(void *this) {
 
 DEF_EVENT(ClientActive, struct edict */*player*/)
 DEF_EVENT(Tick, bool /*simulating*/)
+DEF_EVENT(LevelShutdown)
 
 // Quick and easy server tick event. Eventually, we might want a deeper hook
 // for anything timing-sensitive, but this will do for our current needs.
@@ -643,6 +661,10 @@ static void VCALLCONV GameFrame(void *this, bool simulating) {
 	EMIT_Tick(simulating);
 }
 
+static void VCALLCONV LevelShutdown(void *this) {
+	EMIT_LevelShutdown();
+}
+
 static void VCALLCONV ClientActive(void *this, struct edict *player) {
 	EMIT_ClientActive(player);
 }
@@ -660,7 +682,7 @@ static const void *vtable[MAX_VTABLE_FUNCS] = {
 	(void *)&nop_p_v,	// LevelInit
 	(void *)&nop_pii_v,	// ServerActivate
 	(void *)&GameFrame,
-	(void *)&nop_v_v,	// LevelShutdown
+	(void *)&LevelShutdown,
 	(void *)&ClientActive
 	// At this point, Alien Swarm and Portal 2 add ClientFullyConnect, so we
 	// can't hardcode any more of the layout!
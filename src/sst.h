@@ -23,6 +23,7 @@
 
 DECL_EVENT(ClientActive, struct edict */*player*/)
 DECL_EVENT(Tick, bool /*simulating*/)
+DECL_EVENT(LevelShutdown, void)
 
 DECL_PREDICATE(AllowPluginLoading, void)
 DECL_EVENT(PluginLoaded, void)
@@ -35,6 +36,9 @@ extern bool sst_earlyloaded;
 /* similar query for how we are being unloaded - ONLY valid during unload */
 extern bool sst_userunloaded;
 
+/* Returns the OS-specific library handle of the plugin itself. */
+void *sst_ownhandle();
+
 #endif
 
 // vi: sw=4 ts=4 noet tw=80 cc=80
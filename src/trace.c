@@ -15,11 +15,14 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
+
 #include "engineapi.h"
 #include "errmsg.h"
 #include "feature.h"
 #include "gametype.h"
 #include "intdefs.h"
+#include "sst.h"
 #include "trace.h"
 #include "vcall.h"
 
@@ -45,16 +48,53 @@ static inline bool nonzero(struct vec3f v) {
 	return (u.x | u.y | u.z) << 1 != 0; // ignore sign bit
 }
 
+// ray setup is done 4 floats at a time, since every vector in struct ray is
+// 16-byte aligned with a spare 4 bytes on the end anyway
+typedef float v4f __attribute__((vector_size(16)));
+
+static inline v4f load3(const struct vec3f *v) {
+	return (v4f){v->x, v->y, v->z, 0.0f};
+}
+
+static inline void store3(struct vec3f *dst, v4f v) {
+	memcpy(dst, &v, sizeof(v)); // n.b. clobbers the padding, which is fine
+}
+
+static inline void setupline(struct ray *r, const struct vec3f *start,
+		const struct vec3f *end) {
+	v4f s = load3(start), d = load3(end) - s;
+	store3(&r->start, s);
+	store3(&r->delta, d);
+	store3(&r->startoff, (v4f){0});
+	store3(&r->extents, (v4f){0});
+	r->worldaxistransform = 0;
+	r->isray = true;
+	r->isswept = nonzero(r->delta);
+}
+
+static inline void setuphull(struct ray *r, const struct vec3f *start,
+		const struct vec3f *end, const struct vec3f *mins,
+		const struct vec3f *maxs) {
+	v4f s = load3(start), d = load3(end) - s;
+	v4f lo = load3(mins), hi = load3(maxs);
+	v4f ext = (hi - lo) * 0.5f;
+	v4f sq = ext * ext;
+	store3(&r->start, s);
+	store3(&r->delta, d);
+	store3(&r->extents, ext);
+	store3(&r->startoff, (lo + hi) * -0.5f);
+	r->worldaxistransform = 0;
+	// NOTE: could maybe hardcode this to false, but we copy engine logic just
+	// on the off chance we're tracing some insanely thin hull
+	r->isray = sq[0] + sq[1] + sq[2] < 1e-6f;
+	r->isswept = nonzero(r->delta);
+}
+
 struct CGameTrace trace_line(struct vec3f start, struct vec3f end, uint mask,
 		void *filt) {
 	struct CGameTrace t;
-	struct vec3f delta = {end.x - start.x, end.y - start.y, end.z - start.z};
-	struct ray r = {
-		.isray = true,
-		.isswept = nonzero(delta),
-		.start = start,
-		.delta = delta
-	};
+	struct ray r;
+	setupline(&r, &start, &end);
 	TraceRay(srvtrace, &r, mask, filt, &t);
 	return t;
 }
@@ -62,31 +102,130 @@ struct CGameTrace trace_line(struct vec3f start, struct vec3f end, uint mask,
 struct CGameTrace trace_hull(struct vec3f start, struct vec3f end,
 		struct vec3f mins, struct vec3f maxs, uint mask, void *filt) {
 	struct CGameTrace t;
-	struct vec3f delta = {end.x - start.x, end.y - start.y, end.z - start.z};
-	struct vec3f extents = {
-		(maxs.x - mins.x) * 0.5f,
-		(maxs.y - mins.y) * 0.5f,
-		(maxs.z - mins.z) * 0.5f
-	};
-	struct ray r = {
-		// NOTE: could maybe hardcode this to false, but we copy engine logic
-		// just on the off chance we're tracing some insanely thin hull
-		.isray = (extents.x * extents.x + r.extents.y * r.extents.y +
-				extents.z * extents.z) < 1e-6,
-		.isswept = nonzero(delta),
-		.start = start,
-		.delta = delta,
-		.extents = extents,
-		.startoff = {
-			(mins.x + maxs.x) * -0.5f,
-			(mins.y + maxs.y) * -0.5f,
-			(mins.z + maxs.z) * -0.5f
-		}
-	};
+	struct ray r;
+	setuphull(&r, &start, &end, &mins, &maxs);
 	TraceRay(srvtrace, &r, mask, filt, &t);
 	return t;
 }
 
+// rays are set up in chunks of this many before tracing them one by one, so
+// that the setup loop can stay tight and vectorised
+#define BATCHSZ 16
+
+static void tracebatch(int n, struct ray *rays, uint mask, void *filt,
+		const struct trace_batchresults *res, int base) {
+	struct CGameTrace t;
+	for (int i = 0; i < n; ++i) {
+		TraceRay(srvtrace, rays + i, mask, filt, &t);
+		int j = base + i;
+		if (res->frac) res->frac[j] = t.base.frac;
+		if (res->endpos) res->endpos[j] = t.base.endpos;
+		if (res->flags) {
+			res->flags[j] = (t.base.frac != 1.0f) * TRACE_HIT |
+					t.base.startsolid * TRACE_STARTSOLID |
+					t.base.allsolid * TRACE_ALLSOLID;
+		}
+	}
+}
+
+void trace_lines(int n, const struct vec3f *starts, const struct vec3f *ends,
+		uint mask, void *filt, const struct trace_batchresults *res) {
+	struct ray rays[BATCHSZ];
+	for (int base = 0; base < n; base += BATCHSZ) {
+		int m = n - base < BATCHSZ ? n - base : BATCHSZ;
+		for (int i = 0; i < m; ++i) {
+			setupline(rays + i, starts + base + i, ends + base + i);
+		}
+		tracebatch(m, rays, mask, filt, res, base);
+	}
+}
+
+void trace_hulls(int n, const struct vec3f *starts, const struct vec3f *ends,
+		const struct vec3f *mins, const struct vec3f *maxs, uint mask,
+		void *filt, const struct trace_batchresults *res) {
+	struct ray rays[BATCHSZ];
+	for (int base = 0; base < n; base += BATCHSZ) {
+		int m = n - base < BATCHSZ ? n - base : BATCHSZ;
+		for (int i = 0; i < m; ++i) {
+			int j = base + i;
+			setuphull(rays + i, starts + j, ends + j, mins + j, maxs + j);
+		}
+		tracebatch(m, rays, mask, filt, res, base);
+	}
+}
+
+// cache for the trace_*_cached() functions. entries from earlier ticks just
+// count as empty, so there's never any need to clear the table out.
+#define CACHE_SZ 256 // power of 2!
+#define CACHE_PROBES 8
+
+struct cachekey {
+	void *filt;
+	const void *passent;
+	struct vec3f start, end, mins, maxs;
+	uint mask;
+};
+
+static struct cacheent {
+	struct cachekey key;
+	uint tick;
+	struct CGameTrace t;
+} cache[CACHE_SZ];
+static uint curtick = 1; // zeroed entries are never current
+
+HANDLE_EVENT(Tick, bool simulating) {
+	// nothing in the world moves unless the server is actually simulating
+	if (simulating && !++curtick) curtick = 1;
+}
+
+HANDLE_EVENT(LevelShutdown) {
+	// the next map (or a reload of this one) might start on the same tick
+	// without any simulation in between, so make sure nothing carries over
+	if (!++curtick) curtick = 1;
+}
+
+static inline uint hashkey(const struct cachekey *k) {
+	const uchar *p = (const uchar *)k;
+	uint h = 0x811C9DC5;
+	for (int i = 0; i < sizeof(*k); ++i) h = (h ^ p[i]) * 0x01000193;
+	return h;
+}
+
+static struct CGameTrace cachedtrace(struct vec3f start, struct vec3f end,
+		struct vec3f mins, struct vec3f maxs, uint mask, void *filt,
+		const void *passent, bool hull) {
+	struct cachekey k;
+	memset(&k, 0, sizeof(k)); // make sure padding is consistent for memcmp
+	k.filt = filt; k.passent = passent; k.mask = mask;
+	k.start = start; k.end = end; k.mins = mins; k.maxs = maxs;
+	uint h = hashkey(&k);
+	struct cacheent *slot = 0;
+	for (uint i = 0; i < CACHE_PROBES; ++i) {
+		struct cacheent *e = cache + ((h + i) & (CACHE_SZ - 1));
+		if (e->tick != curtick) { if (!slot) slot = e; continue; }
+		if (!memcmp(&e->key, &k, sizeof(k))) return e->t;
+	}
+	// if every probed slot is in use this tick, just evict the first one
+	if (!slot) slot = cache + (h & (CACHE_SZ - 1));
+	slot->key = k;
+	slot->tick = curtick;
+	slot->t = hull ? trace_hull(start, end, mins, maxs, mask, filt) :
+			trace_line(start, end, mask, filt);
+	return slot->t;
+}
+
+struct CGameTrace trace_line_cached(struct vec3f start, struct vec3f end,
+		uint mask, void *filt, const void *passent) {
+	return cachedtrace(start, end, (struct vec3f){0}, (struct vec3f){0}, mask,
+			filt, passent, false);
+}
+
+struct CGameTrace trace_hull_cached(struct vec3f start, struct vec3f end,
+		struct vec3f mins, struct vec3f maxs, uint mask, void *filt,
+		const void *passent) {
+	return cachedtrace(start, end, mins, maxs, mask, filt, passent, true);
+}
+
 INIT {
 	if (!(srvtrace = factory_engine("EngineTraceServer003", 0))) {
 		errmsg_errorx("couldn't get server-side tracing interface");
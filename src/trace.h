@@ -55,6 +55,57 @@ struct CGameTrace trace_line(struct vec3f start, struct vec3f end, uint mask,
 struct CGameTrace trace_hull(struct vec3f start, struct vec3f end,
 		struct vec3f mins, struct vec3f maxs, uint mask, void *filt);
 
+/*
+ * Versions of trace_line() and trace_hull() which remember their results for
+ * the rest of the current server tick, so repeated identical queries (e.g. from
+ * a command bound to a key, or an overlay redrawn every frame) don't hit the
+ * engine each time. The cache is keyed on every parameter, including the filter
+ * pointer, but since filters are opaque, passent must be given as well: this
+ * should be the filter's pass entity, or anything else that distinguishes how
+ * the filter will behave. Anything that moves an entity within the same tick
+ * (e.g. a teleport) may leave stale results around until the next tick, so
+ * callers doing that should use the uncached functions.
+ */
+struct CGameTrace trace_line_cached(struct vec3f start, struct vec3f end,
+		uint mask, void *filt, const void *passent);
+struct CGameTrace trace_hull_cached(struct vec3f start, struct vec3f end,
+		struct vec3f mins, struct vec3f maxs, uint mask, void *filt,
+		const void *passent);
+
+/*
+ * Results of a batch of traces, in structure-of-arrays form. Each non-null
+ * member must point to an array with room for every trace in the batch; any
+ * member can be left null if the caller doesn't care about it.
+ */
+struct trace_batchresults {
+	float *frac;
+	struct vec3f *endpos;
+	uchar *flags; // see below
+};
+
+/* Bits set in trace_batchresults.flags. */
+enum {
+	TRACE_HIT = 1, // the fraction was less than 1
+	TRACE_STARTSOLID = 2,
+	TRACE_ALLSOLID = 4
+};
+
+/*
+ * Performs n line traces, from starts[i] to ends[i], all with the same mask
+ * and filter. Cheaper than calling trace_line() n times, since the rays are set
+ * up in bulk and no CGameTrace structs get copied around.
+ */
+void trace_lines(int n, const struct vec3f *starts, const struct vec3f *ends,
+		uint mask, void *filt, const struct trace_batchresults *res);
+
+/*
+ * Performs n hull traces, as with trace_lines() but with each hull given by
+ * mins[i] and maxs[i].
+ */
+void trace_hulls(int n, const struct vec3f *starts, const struct vec3f *ends,
+		const struct vec3f *mins, const struct vec3f *maxs, uint mask,
+		void *filt, const struct trace_batchresults *res);
+
 #endif
 
 // vi: sw=4 ts=4 noet tw=80 cc=80
@@ -33,6 +33,14 @@
 	(p) += _len; \
 } while (0)
 
+// same as above, but without the error message. needed in SCAN blocks, which
+// mustn't print anything (see feature.h)
+#define NEXT_INSN_QUIET(p) do { \
+	int _len = x86_len(p); \
+	if_cold (_len == -1) return 0; \
+	(p) += _len; \
+} while (0)
+
 #endif
 
 // vi: sw=4 ts=4 noet tw=80 cc=80
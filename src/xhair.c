@@ -20,6 +20,7 @@
 #include "gamedata.h"
 #include "hexcolour.h"
 #include "hud.h"
+#include "langext.h"
 #include "vcall.h"
 
 FEATURE("custom crosshair drawing")
@@ -41,21 +42,23 @@ DEF_FEAT_CVAR(sst_xhair_dot,
 DEF_FEAT_CVAR(sst_xhair_outline,
 		"Whether to draw outline around custom crosshair", 0, CON_ARCHIVE)
 
-static struct rgba colour = {255, 255, 255, 255};
+// the geometry only depends on the screen size and cvars, so it's laid out up
+// front by the HUD element system and just replayed each frame
+static struct hud_drawcmd cmds[10]; // up to 5 rects, each with an outline
 
-static void colourcb(struct con_var *v) {
-	hexcolour_rgba(colour.bytes, con_getvarstr(v));
-}
-
-static inline void drawrect(int x0, int y0, int x1, int y1, struct rgba colour,
-		bool outline) {
-	hud_drawrect(x0, y0, x1, y1, colour, true);
-	if (outline) hud_drawrect(x0, y0, x1, y1, (struct rgba){.a = 255}, false);
+// n.b. the lines don't overlap each other, but the dot can overlap the lines if
+// there's an outline, so it goes in a layer on top
+static inline void addrect(int layer, int x0, int y0, int x1, int y1,
+		struct rgba colour, bool outline) {
+	hud_cacherect(layer, x0, y0, x1, y1, colour, true);
+	if (outline) {
+		hud_cacherect(layer, x0, y0, x1, y1, (struct rgba){.a = 255}, false);
+	}
 }
 
-HANDLE_EVENT(HudPaint, int w, int h) {
-	if (!con_getvari(sst_xhair)) return;
-	if (has_vtidx_IsInGame && engclient && !IsInGame(engclient)) return;
+static void layout(int w, int h) {
+	struct rgba colour;
+	hexcolour_rgba(colour.bytes, con_getvarstr(sst_xhair_colour));
 	int thick = con_getvari(sst_xhair_thickness);
 	int thick1 = (thick + 1) / 2, thick2 = thick - thick1;
 	int sz = con_getvari(sst_xhair_size);
@@ -64,18 +67,34 @@ HANDLE_EVENT(HudPaint, int w, int h) {
 	int x = w / 2, y = h / 2;
 	bool ol = !!con_getvari(sst_xhair_outline);
 	if (sz) {
-		drawrect(x - thick1, y - sz - gap1, x + thick2, y - gap1, colour, ol);
-		drawrect(x - thick1, y + gap2, x + thick2, y + sz + gap2, colour, ol);
-		drawrect(x - sz - gap1, y - thick1, x - gap1, y + thick2, colour, ol);
-		drawrect(x + gap2, y - thick1, x + sz + gap2, y + thick2, colour, ol);
+		addrect(0, x - thick1, y - sz - gap1, x + thick2, y - gap1, colour, ol);
+		addrect(0, x - thick1, y + gap2, x + thick2, y + sz + gap2, colour, ol);
+		addrect(0, x - sz - gap1, y - thick1, x - gap1, y + thick2, colour, ol);
+		addrect(0, x + gap2, y - thick1, x + sz + gap2, y + thick2, colour, ol);
 	}
 	if (con_getvari(sst_xhair_dot) && (gap >= thick || ol)) {
-		drawrect(x - thick1, y - thick1, x + thick2, y + thick2, colour, ol);
+		addrect(1, x - thick1, y - thick1, x + thick2, y + thick2, colour, ol);
 	}
 }
 
+static bool paint() {
+	return !has_vtidx_IsInGame || !engclient || IsInGame(engclient);
+}
+
+static struct hud_element elem = {
+	.layout = &layout,
+	.paint = &paint,
+	.cmds = cmds,
+	.maxcmds = countof(cmds)
+};
+
 INIT {
-	sst_xhair_colour->cb = &colourcb;
+	elem.enable = sst_xhair;
+	struct con_var *vars[] = {
+		sst_xhair_colour, sst_xhair_thickness, sst_xhair_size, sst_xhair_gap,
+		sst_xhair_dot, sst_xhair_outline
+	};
+	if (!hud_addelement(&elem, vars, countof(vars))) return FEAT_FAIL;
 	return FEAT_OK;
 }
 
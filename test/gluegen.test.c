@@ -0,0 +1,99 @@
+/* This file is dedicated to the public domain. */
+
+{.desc = "gluegen's parallel source scanning"};
+
+// N.B. gluegen can only run once per process, so each run is its own (forked)
+// test case, with results compared at the end.
+
+#ifdef _WIN32
+#include <Windows.h> // before os.h, as gluegen.c does it
+#endif
+#include "../src/os.h"
+#undef OS_MAIN
+#define OS_MAIN _gluegen_main // avoid clashing with the test driver's main()
+#include "../src/build/gluegen.c"
+#define die _cmeta_die // both files have their own static die()
+#include "../src/build/cmeta.c"
+#undef die
+#include "../src/os.c"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SEQOUT ".build/gluegen.test.seq.h"
+#define PAROUT ".build/gluegen.test.par.h"
+
+static char *readall(const char *path, long *len) {
+	FILE *f = fopen(path, "rb");
+	if (!f) return 0;
+	char *ret = 0;
+	if (fseek(f, 0, SEEK_END) || (*len = ftell(f)) < 0 ||
+			fseek(f, 0, SEEK_SET)) {
+		goto e;
+	}
+	if (!(ret = malloc(*len + 1))) goto e;
+	if (fread(ret, 1, *len, f) != *len) { free(ret); ret = 0; }
+	else ret[*len] = '\0';
+e:	fclose(f);
+	return ret;
+}
+
+// the source list is pulled out of the compile script itself, so this always
+// covers the real build inputs (sans debug-only stuff, which is appended to the
+// list separately). argv[0] is unused.
+static os_char *files[128] = {OS_LIT("gluegen")};
+static int nfiles = 1;
+
+static bool loadfiles() {
+	if (nfiles > 1) return true;
+	long len;
+	char *s = readall("compile", &len);
+	if (!s) return false;
+	char *p = strstr(s, "\nsrc=\"\\"), *q, *end = s + len;
+	if (!p) goto e;
+	// one file per line, indented, until the closing quote. tolerate CRLF in
+	// case of an overly helpful git checkout on Windows.
+	for (p += 7; p < end; p = q) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+				*p == '\n')) {
+			++p;
+		}
+		for (q = p; q < end && *q != '\r' && *q != '\n' && *q != '"'; ++q);
+		if (q > p) {
+			if (nfiles == countof(files)) goto e;
+			os_char *f = malloc((4 + q - p + 1) * sizeof(*f));
+			if (!f) goto e;
+			os_spancopy(f, OS_LIT("src/"), 4);
+			// widen char by char on Windows; paths are all plain ASCII
+			for (int i = 0; i < q - p; ++i) f[4 + i] = p[i];
+			f[4 + q - p] = 0;
+			files[nfiles++] = f;
+		}
+		if (q == end || *q == '"') break;
+	}
+e:	free(s);
+	return nfiles > 1;
+}
+
+TEST("Sequential scanning should succeed", .timeout = 10000) {
+	if (!loadfiles()) return false;
+	gluegen(nfiles, files, 1, SEQOUT);
+	return true;
+}
+
+TEST("Parallel scanning should succeed", .timeout = 10000) {
+	// deliberately more threads than cores (and probably files) to try and
+	// shake out any scheduling-dependent behaviour
+	if (!loadfiles()) return false;
+	gluegen(nfiles, files, MAX_THREADS, PAROUT);
+	return true;
+}
+
+TEST("Parallel output should be byte-identical to sequential output") {
+	long seqlen, parlen;
+	char *seq = readall(SEQOUT, &seqlen), *par = readall(PAROUT, &parlen);
+	if (!seq || !par) return false;
+	return seqlen == parlen && !memcmp(seq, par, seqlen);
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
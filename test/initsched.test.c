@@ -0,0 +1,83 @@
+/* This file is dedicated to the public domain. */
+
+{.desc = "the feature scan scheduler"};
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../src/chunklets/fastspin.c"
+#include "../src/initsched.c"
+#include "../src/intdefs.h"
+#include "../src/langext.h"
+
+static void nap() {
+#ifdef _WIN32
+	Sleep(1);
+#else
+	usleep(1000);
+#endif
+}
+
+// each task waits (for a while) until both have started. if they ended up
+// running one after the other, the first would give up and report failure.
+static _Atomic int nstarted;
+static _Atomic bool metup[2];
+static void rendezvous(int i) {
+	atomic_fetch_add(&nstarted, 1);
+	for (int n = 0; n < 2000; ++n) {
+		if (atomic_load(&nstarted) == 2) { metup[i] = true; return; }
+		nap();
+	}
+}
+static void meet0() { rendezvous(0); }
+static void meet1() { rendezvous(1); }
+
+TEST("Independent tasks should run concurrently", .timeout = 10000) {
+	// can't expect any parallelism with nothing to run it on!
+	if (ncpus() < 2) return true;
+	static const s16 nodeps[] = {0};
+	struct initsched_task tasks[] = {
+		{&meet0, nodeps, 0, true},
+		{&meet1, nodeps, 0, true}
+	};
+	initsched_run(tasks, countof(tasks));
+	return metup[0] && metup[1];
+}
+
+static _Atomic int order[3], norder;
+static void slowfirst() {
+	for (int i = 0; i < 20; ++i) nap();
+	order[norder++] = 0;
+}
+static void second() { order[norder++] = 1; }
+static void third() { order[norder++] = 2; }
+
+TEST("Tasks should wait for their dependencies to finish", .timeout = 5000) {
+	static const s16 nodeps[] = {0}, dep0[] = {0}, dep1[] = {1};
+	struct initsched_task tasks[] = {
+		{&slowfirst, nodeps, 0, true},
+		{&second, dep0, 1, true},
+		{&third, dep1, 1, true}
+	};
+	initsched_run(tasks, countof(tasks));
+	return norder == 3 && order[0] == 0 && order[1] == 1 && order[2] == 2;
+}
+
+static _Atomic int nran;
+static void shouldntrun() { nran += 100; }
+static void shouldrun() { ++nran; }
+
+TEST("Disabled tasks should be skipped without blocking dependents") {
+	static const s16 nodeps[] = {0}, dep0[] = {0};
+	struct initsched_task tasks[] = {
+		{&shouldntrun, nodeps, 0, false},
+		{&shouldrun, dep0, 1, true}
+	};
+	initsched_run(tasks, countof(tasks));
+	return nran == 1;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
@@ -0,0 +1,87 @@
+/* This file is dedicated to the public domain. */
+
+{.desc = "the lock-free single-producer/single-consumer ring"};
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "../src/intdefs.h"
+#include "../src/langext.h"
+#include "../src/spscring.h"
+
+DEF_SPSCRING(ring8, int, 8)
+DEF_SPSCRING(bigring, uint, 1024)
+
+TEST("Pushing should fail once the ring is full, and succeed after a pop") {
+	static struct ring8 r;
+	for (int i = 0; i < 8; ++i) if (!ring8_push(&r, i)) return false;
+	if (ring8_push(&r, 8)) return false;
+	int out[8];
+	if (ring8_pop(&r, out, 1) != 1 || out[0] != 0) return false;
+	return ring8_push(&r, 8);
+}
+
+TEST("Popping should return elements in order, limited by max") {
+	static struct ring8 r;
+	int out[8];
+	if (ring8_pop(&r, out, 8) != 0) return false;
+	for (int i = 0; i < 5; ++i) ring8_push(&r, i);
+	if (ring8_pop(&r, out, 3) != 3) return false;
+	if (out[0] != 0 || out[1] != 1 || out[2] != 2) return false;
+	if (ring8_pop(&r, out, 8) != 2) return false;
+	return out[0] == 3 && out[1] == 4 && ring8_pop(&r, out, 8) == 0;
+}
+
+TEST("Indices should be able to wrap around without losing anything") {
+	static struct ring8 r;
+	uint start = -3u;
+	r.prod.tail = start; r.prod.headcache = start;
+	r.cons.head = start; r.cons.tailcache = start;
+	for (int n = 0; n < 32; n += 6) {
+		for (int i = 0; i < 6; ++i) if (!ring8_push(&r, n + i)) return false;
+		int out[8];
+		if (ring8_pop(&r, out, 8) != 6) return false;
+		for (int i = 0; i < 6; ++i) if (out[i] != n + i) return false;
+	}
+	return true;
+}
+
+#define NVALS 1000000
+static struct bigring bigr;
+
+#ifdef _WIN32
+static ulong __stdcall producer(void *_) {
+#else
+static void *producer(void *_) {
+#endif
+	for (uint i = 0; i < NVALS;) if (bigring_push(&bigr, i)) ++i;
+	return 0;
+}
+
+TEST("Values should arrive intact and in order across threads",
+		.timeout = 10000) {
+#ifdef _WIN32
+	void *thr = CreateThread(0, 0, &producer, 0, 0, 0);
+	if (!thr) return false;
+#else
+	pthread_t thr;
+	if (pthread_create(&thr, 0, &producer, 0)) return false;
+#endif
+	static uint out[64];
+	bool ok = true;
+	for (uint next = 0; next < NVALS;) {
+		int n = bigring_pop(&bigr, out, countof(out));
+		for (int i = 0; i < n; ++i) if (out[i] != next++) ok = false;
+	}
+#ifdef _WIN32
+	WaitForSingleObject(thr, INFINITE);
+#else
+	pthread_join(thr, 0);
+#endif
+	return ok;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80
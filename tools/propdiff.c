@@ -0,0 +1,290 @@
+// Compares two SendTable dumps written by the sst_propdump command, and
+// optionally checks an entprops.txt against the newer one, suggesting
+// replacements for anything that moved or disappeared.
+// To compile:
+// Unix: $CC -O2 -o.build/propdiff tools/propdiff.c
+// Windows: clang-cl -fuse-ld=lld -O2 -Fe.build/propdiff.exe tools/propdiff.c
+//
+// Usage: propdiff [-q] old.bin new.bin [entprops.txt]
+// -q skips the full list of differences and only reports on entprops.txt.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// see src/propdump.c for a description of the format
+#define FILEVER 2
+
+static const char *argv0;
+
+static void die(const char *fmt, ...) {
+	fprintf(stderr, "%s: ", argv0);
+	va_list va; va_start(va, fmt); vfprintf(stderr, fmt, va); va_end(va);
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static void *xrealloc(void *p, size_t sz) {
+	if (!(p = realloc(p, sz))) die("couldn't allocate memory");
+	return p;
+}
+
+struct prop { char *name; int type, off, sub; };
+struct table { char *name; int nprops; struct prop *props; };
+struct class { char *name; int table; };
+
+// a flattened property path, e.g. CBaseEntity/m_Collision/m_vecMins
+struct ent { char *path; int off, type; };
+
+struct dump {
+	const char *filename;
+	const unsigned char *p, *end;
+	struct table *tables; int ntables;
+	bool *seeing; // tables currently being flattened, to detect cycles
+	struct class *classes; int nclasses;
+	struct ent *ents; int nents, entcap;
+};
+
+static void need(struct dump *d, int n) {
+	if (d->end - d->p < n) die("%s: unexpected end of file", d->filename);
+}
+
+static int getu8(struct dump *d) { need(d, 1); return *d->p++; }
+static int getu16(struct dump *d) {
+	need(d, 2);
+	int ret = d->p[0] | d->p[1] << 8;
+	d->p += 2;
+	return ret;
+}
+static int gets32(struct dump *d) {
+	need(d, 4);
+	unsigned ret = d->p[0] | d->p[1] << 8 | d->p[2] << 16 |
+			(unsigned)d->p[3] << 24;
+	d->p += 4;
+	return (int)ret;
+}
+
+static char *getname(struct dump *d) {
+	int len = getu8(d);
+	need(d, len);
+	char *ret = xrealloc(0, len + 1);
+	memcpy(ret, d->p, len);
+	ret[len] = '\0';
+	d->p += len;
+	return ret;
+}
+
+static int gettable(struct dump *d) {
+	int idx = getu16(d);
+	if (idx == 0xFFFF) return -1;
+	if (idx < d->ntables) return idx;
+	if (idx > d->ntables) die("%s: bad table index %d", d->filename, idx);
+	d->tables = xrealloc(d->tables, (d->ntables + 1) * sizeof(*d->tables));
+	++d->ntables; // n.b. before reading props, matching the writer
+	char *name = getname(d);
+	int nprops = getu16(d);
+	struct prop *props = xrealloc(0, nprops * sizeof(*props) + 1);
+	for (int i = 0; i < nprops; ++i) {
+		props[i].name = getname(d);
+		props[i].type = getu8(d);
+		int isdt = getu8(d);
+		props[i].off = gets32(d);
+		props[i].sub = isdt ? gettable(d) : -1;
+	}
+	// recursion may have moved the array, so index again here
+	d->tables[idx] = (struct table){name, nprops, props};
+	return idx;
+}
+
+static void addent(struct dump *d, const char *path, int off, int type) {
+	if (d->nents == d->entcap) {
+		d->entcap = d->entcap ? d->entcap * 2 : 1024;
+		d->ents = xrealloc(d->ents, d->entcap * sizeof(*d->ents));
+	}
+	char *s = xrealloc(0, strlen(path) + 1);
+	strcpy(s, path);
+	d->ents[d->nents++] = (struct ent){s, off, type};
+}
+
+static void flatten(struct dump *d, int table, char *path, int pathlen,
+		int baseoff) {
+	// a table should never (indirectly) contain itself, but don't trust that
+	if (d->seeing[table]) {
+		fprintf(stderr, "%s: %s: skipping cyclic table reference at %s\n",
+				argv0, d->filename, path);
+		return;
+	}
+	d->seeing[table] = true;
+	const struct table *t = d->tables + table;
+	for (int i = 0; i < t->nprops; ++i) {
+		const struct prop *p = t->props + i;
+		int len = strlen(p->name);
+		if (pathlen + 1 + len + 1 > 4096) continue; // meh, whatever
+		path[pathlen] = '/';
+		memcpy(path + pathlen + 1, p->name, len + 1);
+		int off = baseoff + p->off;
+		addent(d, path, off, p->type);
+		if (p->sub != -1) flatten(d, p->sub, path, pathlen + 1 + len, off);
+	}
+	path[pathlen] = '\0';
+	d->seeing[table] = false;
+}
+
+static int cmpent(const void *a, const void *b) {
+	const struct ent *x = a, *y = b;
+	int ret = strcmp(x->path, y->path);
+	// duplicate paths can happen; keep a stable order so the diff is sane
+	return ret ? ret : (x->off > y->off) - (x->off < y->off);
+}
+
+static char *readfile(const char *filename, long *len) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) die("couldn't open %s", filename);
+	if (fseek(f, 0, SEEK_END) || (*len = ftell(f)) < 0 ||
+			fseek(f, 0, SEEK_SET)) {
+		die("couldn't get size of %s", filename);
+	}
+	char *ret = xrealloc(0, *len + 1);
+	if (fread(ret, 1, *len, f) != *len) die("couldn't read %s", filename);
+	ret[*len] = '\0';
+	fclose(f);
+	return ret;
+}
+
+static void load(struct dump *d, const char *filename) {
+	long len;
+	d->filename = filename;
+	d->p = (const unsigned char *)readfile(filename, &len);
+	d->end = d->p + len;
+	need(d, 9);
+	if (memcmp(d->p, "SSTPROPS", 8)) die("%s: not a prop dump", filename);
+	d->p += 8;
+	int ver = getu8(d);
+	if (ver != FILEVER) die("%s: unsupported version %d", filename, ver);
+	int nclasses = getu16(d);
+	d->classes = xrealloc(0, nclasses * sizeof(*d->classes) + 1);
+	for (; d->nclasses < nclasses; ++d->nclasses) {
+		char *name = getname(d);
+		d->classes[d->nclasses] = (struct class){name, gettable(d)};
+	}
+	d->seeing = xrealloc(0, d->ntables + 1);
+	memset(d->seeing, 0, d->ntables + 1);
+	static char path[4096];
+	for (int i = 0; i < d->nclasses; ++i) {
+		if (d->classes[i].table == -1) continue;
+		int len = strlen(d->classes[i].name);
+		if (len >= sizeof(path)) continue;
+		memcpy(path, d->classes[i].name, len + 1);
+		flatten(d, d->classes[i].table, path, len, 0);
+	}
+	qsort(d->ents, d->nents, sizeof(*d->ents), &cmpent);
+}
+
+static const struct ent *find(const struct dump *d, const char *path) {
+	int lo = 0, hi = d->nents;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int c = strcmp(d->ents[mid].path, path);
+		if (c < 0) lo = mid + 1; else hi = mid;
+	}
+	return lo < d->nents && !strcmp(d->ents[lo].path, path) ?
+			d->ents + lo : 0;
+}
+
+static void diff(const struct dump *old, const struct dump *new) {
+	int i = 0, j = 0;
+	while (i < old->nents || j < new->nents) {
+		int c = i == old->nents ? 1 : j == new->nents ? -1 :
+				strcmp(old->ents[i].path, new->ents[j].path);
+		if (c < 0) {
+			printf("- %s (offset %d)\n", old->ents[i].path, old->ents[i].off);
+			++i;
+		}
+		else if (c > 0) {
+			printf("+ %s (offset %d)\n", new->ents[j].path, new->ents[j].off);
+			++j;
+		}
+		else {
+			if (old->ents[i].off != new->ents[j].off) {
+				printf("~ %s: offset %d -> %d\n", old->ents[i].path,
+						old->ents[i].off, new->ents[j].off);
+			}
+			++i; ++j;
+		}
+	}
+}
+
+// suggests where a property might have gone: anything in the same class with
+// the same leaf name, or failing that, anything now at the old offset.
+static int suggest(const struct dump *new, const char *var, const char *path,
+		const struct ent *oldent) {
+	const char *slash = strchr(path, '/');
+	const char *leaf = strrchr(path, '/');
+	if (!slash) return 0;
+	int classlen = slash - path + 1; // including the slash
+	int nfound = 0;
+	for (int pass = 0; pass < 2 && !nfound; ++pass) {
+		if (pass == 1 && !oldent) break;
+		for (int i = 0; i < new->nents; ++i) {
+			const struct ent *e = new->ents + i;
+			if (strncmp(e->path, path, classlen)) continue;
+			bool match = pass == 0 ?
+					!strcmp(strrchr(e->path, '/'), leaf) :
+					e->off == oldent->off && e->type == oldent->type;
+			if (match) {
+				printf("  suggest: %s %s (offset %d)\n", var, e->path, e->off);
+				++nfound;
+			}
+		}
+	}
+	return nfound;
+}
+
+static void checkentprops(const struct dump *old, const struct dump *new,
+		const char *filename) {
+	long len;
+	char *s = readfile(filename, &len);
+	int lineno = 0, nok = 0, nbad = 0;
+	for (char *line = s, *next; *line; line = next) {
+		++lineno;
+		next = line + strcspn(line, "\n");
+		if (*next) *next++ = '\0';
+		char *hash = strchr(line, '#');
+		if (hash) *hash = '\0';
+		char var[256], path[4096];
+		if (sscanf(line, " %255s %4095s", var, path) != 2) continue;
+		const struct ent *o = find(old, path), *n = find(new, path);
+		if (n && (!o || o->off == n->off)) { ++nok; continue; }
+		++nbad;
+		if (n) {
+			printf("%s:%d: %s %s: offset %d -> %d\n", filename, lineno, var,
+					path, o->off, n->off);
+			continue;
+		}
+		printf("%s:%d: %s %s: not found in new dump\n", filename, lineno,
+				var, path);
+		if (!suggest(new, var, path, o)) printf("  no suggestions\n");
+	}
+	printf("%s: %d unchanged, %d needing attention\n", filename, nok, nbad);
+}
+
+int main(int argc, char **argv) {
+	argv0 = argv[0];
+	bool quiet = false;
+	if (argc > 1 && !strcmp(argv[1], "-q")) { quiet = true; --argc; ++argv; }
+	if (argc != 3 && argc != 4) {
+		fprintf(stderr, "usage: %s [-q] old.bin new.bin [entprops.txt]\n",
+				argv0);
+		return 1;
+	}
+	static struct dump old, new;
+	load(&old, argv[1]);
+	load(&new, argv[2]);
+	if (!quiet) diff(&old, &new);
+	if (argc == 4) checkentprops(&old, &new, argv[3]);
+	return 0;
+}
+
+// vi: sw=4 ts=4 noet tw=80 cc=80